@@ -2,30 +2,113 @@
 
 #include <FastLED.h>
 
-#define FRAME_ALLOCATION_SIZE 4
+#define FRAME_ALLOCATION_SIZE 4         //initial frame capacity of an animation growing without preflight
+#define FRAME_DATA_ALLOCATION_SIZE 1024 //initial frame data capacity of an animation growing without preflight
+#define DELTA_KEYFRAME_INTERVAL 32  //every Nth delta encoded frame holds the whole canvas
+#define DELTA_PALETTE_SIZE 256      //colors of an animation's shared palette, delta runs are stored as 1 byte indices into it while the colors fit
 
 namespace pixelbox
 {
   namespace anim
   {
+    typedef enum disposal_e  //what happens with the frame's rectangle before drawing the next frame (based on GIF disposal methods)
+    {
+      disposal_none = 0,        //not specified, same as keep
+      disposal_keep = 1,        //leave the frame in place
+      disposal_background = 2,  //clear the rectangle to background (black)
+      disposal_previous = 3,    //restore the rectangle to its state before the frame
+    }disposal_e;
+
+    typedef struct delta_run_s   //run of changed pixels in a delta frame
+    {
+      uint16_t offset;  //pixel index on the canvas
+      uint16_t length;  //number of pixels
+    }delta_run_s;
+
     typedef struct frame_s   //one frame of an animation, holding pixel data
     {
       uint32_t delay_ms;     //how long this frame should be displayed
       uint32_t x;            //starting X coord of the frame (based on GIF partial refresh)
       uint32_t y;            //starting Y coord of the frame (based on GIF partial refresh)
-      CRGB* pixels;          //pixel array pointer
-      uint32_t pixels_size;  //pixel array size
+      uint32_t width;        //width of the frame's rectangle
+      uint32_t height;       //height of the frame's rectangle
+      uint8_t disposal;      //disposal method of the frame (disposal_e)
+      CRGB* pixels;          //pixel array pointer, NULL if the frame is palette indexed
+      uint32_t pixels_size;  //pixel (or index) array size
+      uint8_t* indices;      //palette index array pointer, NULL if the frame holds CRGB pixels
+      CRGB* palette;         //palette of an indexed frame (pixel or run indices), shared between frames in an animation (palette effects can modify it in place)
+      uint32_t palette_size; //palette size, out of range indices are drawn black
+      uint8_t* mask;         //transparency bit mask, set bit = transparent pixel, NULL if the frame is opaque
+      delta_run_s* runs;     //changed pixels relative to the previous frame covering the whole canvas, NULL if not a delta frame
+      uint32_t runs_size;    //run array size
+      CRGB* run_colors;      //colors of the runs one after another, stored in the same block as runs, NULL if the runs are indexed
+      uint8_t* run_indices;  //palette indices of the runs' pixels instead of run_colors, in the same block as runs
+      uint32_t light[3];     //per channel sum of the canvas' linear light after the frame (see color::light), computed once by the delta encoder for current limiting
+      bool light_valid;      //light is known, otherwise the renderer measures the canvas
     }frame_s;
 
-    typedef struct animation_s   //animation consisting multiple frames
+    typedef struct animation_s   //animation consisting multiple frames, stored in one slab: frame array followed by the frames' data
     {
-      frame_s* frames;            //frame array pointer
+      frame_s* frames;            //frame array pointer, start of the slab
       uint32_t frames_size;       //frame array used size 
       uint32_t frames_allocated;  //frame array allocated size
       uint32_t frame_index;       //actual frame index in the animation
+      uint8_t* data;              //frame data (pixels, masks, runs, the shared palette) in the slab after the frame array
+      uint32_t data_size;         //frame data used size
+      uint32_t data_allocated;    //frame data allocated size
     }animation_s;
     
-    bool add_frame(animation_s* anim, uint32_t delay_ms, uint32_t x, uint32_t y, CRGB* pixels, uint32_t pixels_size); //add a frame to an animation and copy associated data (dynamic mem allocation, using calloc/realloc)
-    bool animation_init(animation_s* anim); //init animation struct, reset if it contains data (dynamic mem deallocation, using free)
+    typedef struct delta_encoder_s   //state of building delta frames, composites the added frames like the renderer
+    {
+      CRGB* buffer;           //block of the canvases below
+      CRGB* canvas;           //canvas after the last added frame
+      CRGB* next;             //canvas being composited
+      CRGB* saved;            //canvas area saved for disposal_previous
+      uint32_t width;
+      uint32_t height;
+      uint32_t last_x;        //rectangle and disposal method of the last added frame
+      uint32_t last_y;
+      uint32_t last_width;
+      uint32_t last_height;
+      uint8_t last_disposal;
+      bool next_begun;        //next already holds the last canvas with its frame's disposal applied (see begin_delta_frame)
+      uint32_t frames_count;  //number of encoded frames, for keyframe placement
+      CRGB* palette;          //colors of the indexed runs so far (DELTA_PALETTE_SIZE), only appended to, so the indices of the encoded frames stay valid
+      uint32_t palette_size;
+      uint32_t palette_hit;   //index of the last looked up color, neighbouring pixels often share it
+      bool indexed;           //the colors fit in the palette so far, from the first frame overflowing it the runs hold CRGB colors
+    }delta_encoder_s;
+
+    typedef bool (*next_frame_cb)(void* user, frame_s* frame); //fill the next frame, false if there are no more frames
+
+    typedef void (*prefetch_cb)(void* user); //prepare the next frame ahead of time
+
+    typedef struct frame_source_s  //animation decoded frame by frame during playback
+    {
+      next_frame_cb next_frame;  //frame data has to be valid until the next call
+      void* user;
+      prefetch_cb prefetch;      //called after a frame is shown, slow work (eg. flash reads) is done during the frame's delay instead of before the next show, NULL if not needed
+    }frame_source_s;
+    
+    //preflight: reserving the exact frame count and frame data size makes the animation a single allocation, otherwise the slab grows geometrically (and is shrunk when complete)
+    bool animation_reserve(animation_s* anim, uint32_t frames, uint32_t bytes); //make room for frames more frames and bytes more frame data (dynamic mem allocation, using realloc)
+    void animation_shrink(animation_s* anim); //drop the slack of a grown slab when the animation is complete (using realloc)
+    bool add_frame(animation_s* anim, const frame_s* frame); //add a CRGB pixels frame to an animation and copy associated data into the slab (grows the slab if necessary)
+    bool animation_init(animation_s* anim); //init animation struct, reset if it contains data (frees the slab)
+    void animation_move(animation_s* dst, animation_s* src); //hand the slab over, dst is reset before, src is left empty
+    void animation_clear(animation_s* anim); //drop the frames but keep the slab for reuse
+    bool animation_copy(animation_s* dst, const animation_s* src); //copy the frames into a new exact size slab (dynamic mem allocation, using malloc), dst is reset before, it starts from the first frame
+
+    //delta frames store only the pixels changed since the previous frame, memory scales with motion instead of frame count
+    bool delta_encoder_init(delta_encoder_s* encoder, uint32_t width, uint32_t height); //canvas size of the animation (dynamic mem allocation, using calloc)
+    void delta_encoder_deinit(delta_encoder_s* encoder);
+    const CRGB* begin_delta_frame(delta_encoder_s* encoder); //canvas the next added frame is drawn over (the last one after its disposal), eg. to blend semi-transparent pixels against it while decoding
+    bool add_delta_frame(animation_s* anim, delta_encoder_s* encoder, const frame_s* frame); //composite the frame and add the changed runs as a new frame (every DELTA_KEYFRAME_INTERVAL-th frame is a keyframe), the runs are palette indexed while the colors fit
+    bool delta_encoder_finish(animation_s* anim, delta_encoder_s* encoder); //store the shared palette of the indexed frames in the slab, once after the last frame (grows the slab if necessary)
+
+    //compositing partial frames onto a canvas, everything is clipped to the canvas
+    void blit(const frame_s* frame, CRGB* canvas, uint32_t canvas_width, uint32_t canvas_height); //draw the frame, skipping transparent pixels, indexed frames and runs are expanded through their palette, delta frames write their runs
+    void fill_rect(CRGB* canvas, uint32_t canvas_width, uint32_t canvas_height, uint32_t x, uint32_t y, uint32_t width, uint32_t height, CRGB color);
+    void copy_rect(CRGB* dst, const CRGB* src, uint32_t canvas_width, uint32_t canvas_height, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
   } 
 }
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <FastLED.h>
+
+#define COLOR_GAMMA 2.2              //gamma of the images (sRGB-like pixel art), the LEDs' PWM is linear
+#define COLOR_CORRECTION 0xFFFFFF    //default 0xRRGGBB white point calibration of the LEDs, 0xFFFFFF is uncorrected
+#define COLOR_DITHER false           //temporal dithering of the fractions of the output levels by default (the LEDs are refreshed on every render then)
+
+namespace pixelbox
+{
+  namespace color
+  {
+    //output color pipeline: every channel goes through its own 256 entry table of gamma, calibration and brightness
+    //the tables hold 8.8 fixed point levels, the fraction is dithered over the frames or rounded
+    typedef struct color_lut_s
+    {
+      uint16_t r[256];
+      uint16_t g[256];
+      uint16_t b[256];
+    }color_lut_s;
+
+    void set_brightness(uint8_t value);  //scale of the linear output (rebuilds the tables)
+    void set_correction(CRGB correction); //per channel scale of the white point calibration (rebuilds the tables)
+    void set_dither(bool on);
+    bool dithering(); //the output changes from frame to frame even if the image doesn't
+    uint8_t get_brightness();
+    CRGB get_correction();
+    void light(const CRGB* pixels, uint32_t size, uint32_t* sums); //per channel sums of the pixels' linear light in 8 bit levels (without calibration and brightness), the current draw scales with them
+    void apply(const CRGB* in, CRGB* out, uint32_t size); //map the pixels through the tables in one pass, the next frame gets the next dither pattern
+  }
+}
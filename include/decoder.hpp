@@ -0,0 +1,81 @@
+#pragma once
+
+#include <FastLED.h>
+#include <LittleFS.h>
+
+#include "anim.hpp"
+
+#define DECODER_PROBE_SIZE 8 //bytes of the file start the decoders recognise their format by
+#define LAZY_GIF_MIN_FILE_SIZE 2048 //GIFs from this size are decoded frame by frame during playback instead of all at once
+#define PNG_BACKGROUND_COLOR 0x000000 //transparent PNG pixels are composited over this 0xRRGGBB color, black is an unlit LED
+#define NATIVE_MAGIC "PBX4" //signature and version of the native container
+#define NATIVE_MAX_FRAMES 0xFFFF //transcoding stops at this many frames
+#define NATIVE_MAX_LOAD_SIZE 8192 //native containers needing a bigger animation slab (frame array and frame data) are not loaded into RAM, they are played from flash frame by frame
+
+namespace pixelbox
+{
+  namespace decoder
+  {
+    typedef struct sink_s   //final destination of the decoded images, the renderer's frame store
+    {
+      uint32_t width;       //canvas size, images of other sizes are rejected
+      uint32_t height;
+      CRGB* frame;          //buffer of one decoded animation frame, width * height pixels (valid until the next decoding)
+      uint8_t* frame_mask;  //and its transparency mask
+      CRGB* (*begin_image)(void); //stop displaying the previous content, a still image is decoded right into the returned buffer
+      void (*show_image)(void);   //the buffer holds the complete still image
+      void (*show_animation)(anim::animation_s* anim); //display an animation, the slab is moved into the renderer (frame delays are its timing)
+      void (*show_source)(anim::frame_source_s* source); //display an animation decoded frame by frame during playback
+      bool loop;            //frame sources repeat the animation forever, otherwise they end after the last frame
+      void (*yield)(void);  //called by the decoders between frames, the display keeps playing (transitions, the previous animation) while decoding, NULL if not needed
+    }sink_s;
+
+    typedef struct decoder_s   //image format, every format is implemented in its own file and registers itself
+    {
+      const char* name;
+      bool (*probe)(const uint8_t* header, uint32_t len);   //does the file start (DECODER_PROBE_SIZE bytes at most) belong to this format
+      bool (*decode)(const String& filename, File& file, const sink_s* sink); //decode the file into the sink, the file is closed or kept open for playback
+      void (*stop)(void);   //stop decoding during playback, NULL if the format doesn't do it
+      decoder_s* next;      //registry list
+    }decoder_s;
+
+    //native container, images are transcoded into it once at upload and loaded without decoding
+    //layout: header, frame data (every block 4 byte aligned, as in an animation slab), shared palette of the indexed frames, frame table, everything in the device's byte order
+    typedef struct native_header_s
+    {
+      char magic[4];         //NATIVE_MAGIC
+      uint16_t width;
+      uint16_t height;
+      uint32_t frames_size;  //number of frames, a still image has one pixels frame
+      uint32_t data_size;    //bytes of frame data following the header
+      uint32_t table_offset; //offset of the frame table (frames_size entries), entry i is at table_offset + i * sizeof(native_frame_s)
+      uint32_t max_frame_size; //bytes of the biggest frame data, the buffers of playing from flash
+      uint32_t palette_offset; //offset of the shared palette (palette_size CRGB, the last block of the frame data), 0 without indexed frames
+      uint32_t palette_size;   //colors of the shared palette, DELTA_PALETTE_SIZE at most
+    }native_header_s;
+
+    typedef enum native_frame_type_e
+    {
+      native_frame_pixels = 0, //the whole canvas as CRGB pixels
+      native_frame_delta = 1,  //delta runs followed by their colors (see anim::delta_run_s)
+      native_frame_indexed = 2, //delta runs followed by their indices into the shared palette
+    }native_frame_type_e;
+
+    typedef struct native_frame_s   //frame table entry
+    {
+      uint32_t offset;     //offset of the frame data in the file
+      uint32_t size;       //bytes of frame data
+      uint32_t delay_ms;
+      uint16_t runs_size;  //delta runs at the start of the data
+      uint8_t type;        //native_frame_type_e
+      uint8_t keyframe;    //the frame holds the whole canvas, playback can start here
+      uint32_t light[3];   //linear light of the canvas after the frame (see anim::frame_s::light)
+    }native_frame_s;
+
+    bool register_decoder(decoder_s* decoder); //add a format to the registry, called from the format's file during static initialization
+    const decoder_s* find_decoder(const uint8_t* header, uint32_t len); //format of the file start, NULL if unknown
+    bool decode(const String& filename, File& file, const sink_s* sink); //recognise the format by the content and decode the file into the sink
+    void stop(); //stop every decoder working during playback
+    bool transcode(const String& filename, File& file, File& native, uint32_t width, uint32_t height); //decode the file of any format into the native container of a width * height canvas
+  }
+}
@@ -3,7 +3,9 @@
 #include <cstdlib>
 #include <cmath>
 
-#define INDEX_STREAM_ALLOCATION_BLOCK 128
+#define LZW_CODE_TABLE_SIZE 4096 //12 bit is the max code size in GIF
+#define LZW_NO_PREFIX 0xFFFF     //prefix of the single index (trivial) codes
+#define GIF_READ_BUFFER_SIZE 64  //bytes read from the source at once
 
 namespace img_parse
 {
@@ -59,9 +61,10 @@ namespace img_parse
 
   typedef struct
   {
-    uint8_t disposal_method:3;
-    uint8_t user_input_flag:1;
     uint8_t transparent_color_flag:1;
+    uint8_t user_input_flag:1;
+    uint8_t disposal_method:3;
+    uint8_t reserved:3;
   } gce_fields_s;  
   
   typedef struct logical_screen_descriptor_s
@@ -90,15 +93,12 @@ namespace img_parse
     id_fields_s fields;
   } image_descriptor_s;
 
-  typedef struct code_table_entry_s
-  {
-    uint8_t* string;
-    uint8_t string_size;
-  } code_table_entry_s;
-
+  //every string in the table is its prefix code's string plus one index, so strings are never stored, only walked back
   typedef struct code_table_s
   {
-    code_table_entry_s* entries;
+    uint16_t prefix[LZW_CODE_TABLE_SIZE]; //code of the string without its last index
+    uint8_t  suffix[LZW_CODE_TABLE_SIZE]; //last index of the string
+    uint8_t  first[LZW_CODE_TABLE_SIZE];  //first index of the string
     uint32_t entries_count;
     uint16_t cc;
     uint16_t eoi;
@@ -119,34 +119,60 @@ namespace img_parse
     uint8_t starting_code_size;
     uint8_t code_size;
 
-    uint8_t* lzw; //lzw compressed image data after concatenating from image data blocks
-    uint32_t lzw_size;
-    uint32_t lzw_offset_byte;
-    uint8_t  lzw_offset_bit;
+    //lzw bit reader, fed from the image data sub-blocks without concatenating them
+    uint32_t lzw_bits;            //bits read from the sub-blocks but not consumed yet
+    uint8_t  lzw_bits_count;
+    uint8_t  lzw_sub_block_left;  //bytes left from the actual sub-block
 
-    code_table_s code_table;
+    code_table_s* code_table; //borrowed from the context while decoding
 
-    uint8_t* index_stream;  //output pixels pointing to color table indexes
-    uint32_t index_stream_size;
-    uint32_t index_stream_offset;
+    //color table used by the lzw output stage
+    color_s* color_table;
+    uint32_t color_table_size;
+    bool transparency;
 
     uint32_t last_code; //code parsed in the previous step
     uint32_t code; //currently parsed code
 
-    //output data in RGB similar to FastLED
+    //output data in RGB similar to FastLED, covering the image descriptor's rectangle, written directly by the lzw output stage
     color_s* output;  
     uint32_t output_size;
+    uint32_t output_offset;
+    uint8_t* mask;  //transparency bit mask of the output, set bit = transparent pixel, NULL if there is no transparent color
+    bool output_borrowed; //output and mask are supplied by the caller, they are not freed
+    uint8_t* indices;     //color table indices instead of output if the context has indexed output (lct is kept then)
 
   } image_s;  
 
+  //byte source of the parser, returns how many bytes were read, less than len only at the end of the source
+  typedef uint32_t (*read_cb)(void* user, uint8_t* buffer, uint32_t len);
+  //sets the absolute read position of the source, needed for looping frame by frame decoding
+  typedef bool (*seek_cb)(void* user, uint32_t position);
+
+  typedef struct source_s
+  {
+    read_cb read;
+    seek_cb seek;
+    void* user;
+    uint32_t position; //how many bytes were read from the source
+
+    //small read buffer, the source is never read into memory as a whole
+    uint8_t buffer[GIF_READ_BUFFER_SIZE];
+    uint32_t buffer_size;
+    uint32_t buffer_offset;
+  } source_s;
+
   typedef struct gif_parse_context_s
   {
     bool parsed;
 
-    //raw input data to parse
-    uint8_t* input;
+    //raw input data to parse (only if the context was initialized with a buffer), read only
+    const uint8_t* input;
     uint32_t input_size;
-    uint32_t offset;
+    bool input_owned; //input is freed by the context
+
+    source_s source;
+    uint32_t offset; //parsing offset, how many bytes were consumed from the source
 
     logical_screen_descriptor_s lsd;
 
@@ -161,9 +187,37 @@ namespace img_parse
     image_s* images;
     uint32_t images_size;
 
+    //lzw dictionary, allocated once and reused by every image and clear code
+    code_table_s* code_table;
+
+    //optional caller supplied destination for the decoded images (see set_output)
+    color_s* output;
+    uint32_t output_size;
+    uint8_t* output_mask;
+    bool indexed_output;
+
+    //frame by frame decoding, only the last decoded image is kept in images
+    bool lazy;
+    uint32_t first_block_offset; //offset of the first block after the gct, decoding restarts here on loop
+    uint32_t loop_count;         //how many times the decoding reached the trailer and restarted
+    uint32_t loop_images;        //images in one loop, valid if loop_count > 0
+    uint32_t pass_images;        //images decoded since the last restart
+
   } gif_parse_context_s;
 
-  error_code_e init(gif_parse_context_s& ctx, uint8_t* input, uint32_t input_size);
-  error_code_e parse(gif_parse_context_s& ctx);
+  error_code_e init(gif_parse_context_s& ctx, const uint8_t* input, uint32_t input_size); //copy the input (dynamic mem allocation, using calloc)
+  error_code_e init_borrowed(gif_parse_context_s& ctx, const uint8_t* input, uint32_t input_size); //parse the caller's buffer (eg. memory mapped flash) in place, it must be valid while the context is used
+  error_code_e init_owned(gif_parse_context_s& ctx, uint8_t* input, uint32_t input_size); //take ownership of a malloc'd buffer, the context frees it
+  error_code_e init(gif_parse_context_s& ctx, read_cb read, seek_cb seek, void* user); //parse from a stream, eg. a file (seek is optional for parse)
+  error_code_e parse(gif_parse_context_s& ctx); //decode every image at once
+
+  //frame by frame decoding: parse the header once, then get the images one by one, the decoding loops at the trailer
+  error_code_e parse_header(gif_parse_context_s& ctx);
+  error_code_e parse_next_image(gif_parse_context_s& ctx, image_s** image); //image is valid until the next call, ctx.parsed is set if it was the last one of the pass
+
+  //decode every following image into the caller's buffer instead of allocating one per image (mask needs (output_size + 7) / 8 bytes)
+  error_code_e set_output(gif_parse_context_s& ctx, color_s* output, uint32_t output_size, uint8_t* mask);
+  //decode color table indices (image_s::indices) instead of colors, the images' color table stays available
+  error_code_e set_indexed_output(gif_parse_context_s& ctx);
   void deinit(gif_parse_context_s& ctx);  
 }
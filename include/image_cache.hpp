@@ -0,0 +1,35 @@
+#pragma once
+
+#include <FastLED.h>
+
+#include "anim.hpp"
+#include "decoder.hpp"
+
+#define IMAGE_CACHE_ENTRIES 8            //recently shown images kept decoded in RAM
+#define IMAGE_CACHE_BUDGET 8192          //bytes the cached images may take together
+#define IMAGE_CACHE_MIN_FREE_BLOCK 8192  //the cache gives up its least recently shown images while the biggest free heap block is smaller than this (web server, decoding)
+#define IMAGE_CACHE_NAME_SIZE 32         //LittleFS file name limit, images with longer names are not cached
+
+namespace pixelbox
+{
+  namespace image_cache
+  {
+    //decoded images are cached by file name and version (the size of the image file), showing them again is a copy instead of a decoding
+    //still images and animations decoded into RAM are cached, animations played frame by frame from flash are not
+    typedef struct cache_entry_s
+    {
+      char filename[IMAGE_CACHE_NAME_SIZE]; //empty if the entry is free
+      uint32_t version;        //size of the image file when it was cached
+      uint32_t size;           //bytes of RAM held by the entry
+      uint32_t last_used;      //LRU order, the entry with the smallest value is evicted first
+      CRGB* image;             //still image, NULL if the entry is an animation
+      anim::animation_s animation; //animation slab, empty if the entry is a still image
+    }cache_entry_s;
+
+    bool show(const String& filename, uint32_t version, const decoder::sink_s* sink); //display the cached image through the sink, false if it's not cached
+    const decoder::sink_s* recording_sink(const String& filename, uint32_t version, const decoder::sink_s* sink); //sink decoding into sink and caching the shown image (valid until the next call)
+    void trim(); //evict images while the heap is short, called before decoding
+    void invalidate(const String& filename); //the image was replaced or deleted
+    void clear();
+  }
+}
@@ -11,6 +11,10 @@
 //uPNG (ideas), a very small PNG parsing lib: https://github.com/elanthis/upng
 //tinf (used as third party code), a very tiny implementation of the inflate algo: https://github.com/jibsen/tinf
 
+#define PNG_INFLATE_WINDOW_SIZE 32768 //deflate references at most 32K back, smaller images use a window of their inflated size
+#define PNG_READ_BUFFER_SIZE 1024 //bytes of a streamed PNG held at once, chunks fitting it (every chunk with parsed fields) are read whole, bigger ones pass through it
+#define PNG_INFLATE_FAST_MIN_SIZE 1024 //images inflating to at least this many bytes are decoded with the huffman lookup tables of tinf, for smaller ones building the tables costs more than it saves
+
 namespace img_parse
 {
   //PNG chunk types
@@ -18,10 +22,25 @@ namespace img_parse
   {
     chunk_type_inv  = 0x58585858, //invalid
     chunk_type_ihdr = 0x49484452,
+    chunk_type_plte = 0x504C5445,
+    chunk_type_trns = 0x74524E53,
     chunk_type_idat = 0x49444154,
     chunk_type_iend = 0x49454E44,
+    chunk_type_actl = 0x6163544C, //APNG animation control
+    chunk_type_fctl = 0x6663544C, //APNG frame control
+    chunk_type_fdat = 0x66644154, //APNG frame data
   } chunk_type_e;
 
+  //PNG color types
+  typedef enum color_type_e
+  {
+    color_type_gray = 0,
+    color_type_rgb = 2,
+    color_type_palette = 3,
+    color_type_gray_alpha = 4,
+    color_type_rgba = 6,
+  } color_type_e;
+
   //PNG filter types
   typedef enum filter_method_e
   {
@@ -32,6 +51,21 @@ namespace img_parse
     filter_method_paeth = 4,
   } filter_method_e;
 
+  //APNG frame disposal, what happens with the frame's region before the next frame
+  typedef enum dispose_op_e
+  {
+    dispose_op_none = 0,       //left as it is
+    dispose_op_background = 1, //cleared to fully transparent black
+    dispose_op_previous = 2,   //reverted to the contents before the frame
+  } dispose_op_e;
+
+  //APNG frame blending
+  typedef enum blend_op_e
+  {
+    blend_op_source = 0, //the frame replaces its region, alpha included
+    blend_op_over = 1,   //the frame is composited over its region
+  } blend_op_e;
+
   //PNG header
   typedef struct ihdr_s
   {
@@ -44,6 +78,20 @@ namespace img_parse
     uint8_t  interlace_method;
   } ihdr_s;
 
+  //APNG frame control (fcTL), the whole image for non-animated files
+  typedef struct fctl_s
+  {
+    uint32_t sequence_number;
+    uint32_t width;
+    uint32_t height;
+    uint32_t x_offset;
+    uint32_t y_offset;
+    uint16_t delay_num; //frame delay is delay_num / delay_den seconds
+    uint16_t delay_den; //0 means 100
+    uint8_t dispose_op; //dispose_op_e
+    uint8_t blend_op;   //blend_op_e
+  } fctl_s;
+
   //generic PNG chunk
   typedef struct chunk_data_s
   {
@@ -52,29 +100,124 @@ namespace img_parse
     uint32_t crc32;
   } chunk_data_s;
   
+  //byte source of a streamed PNG (same as the GIF parser's), returns how many bytes were read, less than len only at the end of the source
+  typedef uint32_t (*read_cb)(void* user, uint8_t* buffer, uint32_t len);
+  //sets the absolute read position of the source, needed for rewinding the frames and for skipping without reading
+  typedef bool (*seek_cb)(void* user, uint32_t position);
+
+  typedef bool (*row_cb)(void* user, uint32_t y, const uint8_t* row, uint32_t len); //unfiltered scanline of len bytes (samples as described by the ihdr), valid during the call, false aborts parsing
+
   typedef struct png_parse_context_s
   {
     ihdr_s hdr; //parsed header of the PNG file
-    uint8_t pixel_size;
+    uint8_t channels;   //samples per pixel
+    uint8_t pixel_size; //bytes per complete pixel rounded up to one, the distance of the filters' left neighbour
+    bool header_parsed; //signature, ihdr and the chunks before the image data are parsed
     bool parsed; //file is parsed and unfiltered data/size are valid
 
-    //raw PNG data to parse
-    uint8_t* data;
+    //APNG
+    bool animated;          //acTL found, the frames can be decoded with parse_next_frame
+    uint32_t num_frames;    //acTL
+    uint32_t num_plays;     //acTL, 0 is infinite
+    fctl_s fctl;            //region and timing of the image being decoded
+    bool fctl_pending;      //fctl was read and its image data is not decoded yet
+    uint32_t frame_index;   //frame parse_next_frame decodes next
+    uint32_t frames_offset; //first chunk after the header, the frames are parsed again from here
+
+    //raw PNG data to parse, read only (borrowed from the caller or owned by the context)
+    const uint8_t* data;
     size_t size;
     uint32_t offset;
+    bool data_owned; //data is freed by the context
+
+    //streamed input (init with a read callback): data is the read buffer holding data_fill bytes of the source from data_offset on, size is the length of the source
+    read_cb read;
+    seek_cb seek;
+    void* user;
+    uint32_t data_offset;
+    uint32_t data_fill;
+    uint32_t source_position; //read position of the source
 
-    //uncompressed idata data
-    uint8_t* inflated_data;
-    unsigned int inflated_size;
+    //integrity
+    bool validated;              //the file was validated before (eg. at upload, see validator), chunk CRCs are not checked
+    uint32_t crc_checked_offset; //offset of the last chunk with checked CRC, peeking it again doesn't recompute it
 
-    //completely reconstructed image
+    //palette and transparency
+    uint8_t* palette;          //PLTE entries as r, g, b, a (alpha from tRNS, 255 if not given), room for 256 entries
+    uint32_t palette_size;     //number of PLTE entries
+    uint16_t trns_key[3];      //tRNS of color types 0 and 2, gray or rgb samples of this value are transparent
+    bool trns_key_valid;
+    uint8_t background[3];     //transparent pixels are composited over this rgb color, black by default
+
+    //image data is inflated across every IDAT chunk through a bounded window and unfiltered row by row
+    uint8_t* window;           //followed by the tinf workspace (TINF_WORKSPACE_SIZE) for big images
+    uint32_t window_size;
+    uint8_t* rows;             //block of the two scanline buffers, the scanline data of both is 4 byte aligned
+    uint8_t* row;              //scanline being inflated, filter method byte first
+    uint8_t* prev_row;         //previous unfiltered scanline (same layout), zeros before the first one
+    uint32_t row_fill;         //bytes of row already inflated
+    uint32_t data_type;        //IDAT or fdAT, chunks holding the image data being decoded
+    uint8_t zlib_header_left;  //bytes of the zlib header not skipped yet
+    bool data_chunk;           //an image data chunk is being inflated, its crc32 follows the data
+    uint32_t data_left;        //bytes of its data not inflated yet
+    uint8_t sequence_left;     //bytes of its fdAT sequence number not skipped yet
+    bool data_crc_pending;     //its crc32 is computed while inflating (streamed chunks too big to be read whole)
+    uint32_t data_crc;
+    bool idat_parsed;          //image data is decoded, following IDAT chunks are skipped
+    row_cb sink;               //receives the unfiltered scanlines
+    void* sink_user;
+
+    //reconstructed image
     uint32_t scanline_index;
     uint32_t stride;    
-    uint8_t* unfiltered_data;  
+    uint8_t* unfiltered_data;  //completely reconstructed image, only if parsed with parse
     uint32_t unfiltered_size;
+    uint8_t* output;           //rgb triplets, only if parsed with parse_rgb
+    uint32_t output_size;
+    uint8_t* output_palette;   //palette composited over the background as rgb triplets, 256 entries, only during parse_rgb
+    uint8_t* output_mask;      //bit per pixel (lsb first), set for the transparent pixels of blend_op_over frames, only during parse_next_frame
+    const uint8_t* output_backdrop; //rgb triplets of the whole image the blend_op_over frame is composited over (semi-transparent pixels are blended against it instead of the background), only during parse_next_frame
   } png_parse_context_s;
 
-  bool init(png_parse_context_s& ctx, uint8_t* data, uint32_t len);
+  //incremental integrity check of a whole PNG file (signature, chunk structure and CRCs), fed in arbitrary parts (eg. during an upload)
+  typedef enum validator_part_e
+  {
+    validator_part_signature = 0,
+    validator_part_header,
+    validator_part_data,
+    validator_part_crc,
+    validator_part_end, //after the IEND chunk
+  } validator_part_e;
+
+  typedef struct png_validator_s
+  {
+    uint8_t part;       //validator_part_e being read
+    uint8_t buffer[8];  //collected bytes of the signature, chunk header or CRC
+    uint8_t buffered;
+    uint32_t type;      //type of the current chunk
+    uint32_t left;      //bytes left of the current chunk data
+    uint32_t crc;       //CRC of the current chunk type and data so far
+    bool valid;
+  } png_validator_s;
+
+  bool init(png_parse_context_s& ctx, const uint8_t* data, uint32_t len); //copy the input (dynamic mem allocation, using calloc)
+  bool init_borrowed(png_parse_context_s& ctx, const uint8_t* data, uint32_t len); //parse the caller's buffer (eg. memory mapped flash) in place, it must be valid until parse returns
+  bool init_owned(png_parse_context_s& ctx, uint8_t* data, uint32_t len); //take ownership of a malloc'd buffer, the context frees it
+  bool init(png_parse_context_s& ctx, read_cb read, seek_cb seek, void* user, uint32_t len); //parse a stream of len bytes from its start (eg. a file) through a small read buffer, seek is optional (rewind_frames needs it)
   void deinit(png_parse_context_s& ctx);
-  bool parse(png_parse_context_s& ctx);
+  void set_background(png_parse_context_s& ctx, uint8_t r, uint8_t g, uint8_t b); //color behind transparent pixels in parse_rgb, call after init
+  bool parse(png_parse_context_s& ctx); //reconstruct the whole image into unfiltered_data
+  bool parse_rows(png_parse_context_s& ctx, row_cb sink, void* user); //stream the unfiltered scanlines to sink, only two scanlines and the inflate window are allocated
+  bool parse_rgb(png_parse_context_s& ctx, uint8_t* output, uint32_t output_size); //decode any color type and bit depth straight into width * height rgb triplets (eg. a CRGB array), alpha composited over the background
+
+  //APNG, the frames are decoded one at a time through the same streaming path as the IDAT image
+  bool parse_header(png_parse_context_s& ctx); //parse up to the image data, animated tells if the frames can be decoded
+  //decode the next frame's fctl region as rgb triplets, false after the last frame or on error
+  //mask (a bit for every output pixel, may be null) gets the transparent pixels of blend_op_over frames, their semi-transparent pixels are blended against backdrop (rgb triplets of the whole image, eg. the previous frame, may be null for the background)
+  bool parse_next_frame(png_parse_context_s& ctx, uint8_t* output, uint32_t output_size, uint8_t* mask, const uint8_t* backdrop);
+  bool rewind_frames(png_parse_context_s& ctx); //start again from the first frame
+
+  void validator_init(png_validator_s& v);
+  void validator_feed(png_validator_s& v, const uint8_t* data, uint32_t len);
+  bool validator_finish(png_validator_s& v); //the whole file was fed, true if it's an intact PNG
 }
@@ -9,5 +9,6 @@ namespace pixelbox
     void image_updated();
 
     void setup();    
+    void loop();
   }
 }
@@ -12,10 +12,21 @@ namespace pixelbox
     typedef void (*routeCallbackFunction)(AsyncWebServerRequest*);
     typedef void (*voidcb)(void);
 
+    //stored next to every uploaded image
+    typedef struct image_meta_s
+    {
+      uint32_t size;   //size of the image file when the metadata was written, metadata of a replaced file doesn't match
+      bool validated;  //the integrity of the file was checked at upload (PNG chunk CRCs), loading can skip it
+      bool native;     //the image was transcoded after upload into /native/<name>, it's loaded from there (the original is kept for the GUI)
+      bool transcode_pending; //uploaded but not transcoded yet, the main loop transcodes it before displaying it (see state_machine::loop)
+    } image_meta_s;
+
     bool set_displayed_image(String name);
     bool get_displayed_image(String& filename);
     void select_next_image(String name);  
     bool del_image(String name);
+    bool get_image_meta(String name, image_meta_s& meta);
+    bool set_image_meta(String name, const image_meta_s& meta);
     void add_updated_cb(voidcb callback);
 
     void setup();
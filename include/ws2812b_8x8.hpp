@@ -1,7 +1,6 @@
 #pragma once
 
 #include <FastLED.h>
-#include <arduino-timer.h>
 #include "anim.hpp"
 #include "Hash.h"
 
@@ -9,21 +8,65 @@
 #define WS_LED_HEIGHT 8
 #define WS_LED_NUM    (WS_LED_WIDTH * WS_LED_HEIGHT)
 #define WS_DATA_PIN   2
+#define WS_REFRESH_INTERVAL 10000 //ms, unchanged content is sent to the LEDs again this often to recover from glitches, 0 never
+#define WS_IDLE_INTERVAL 33        //ms, render period of still content (brightness changes, refresh)
+#define WS_MIN_FRAME_DELAY 10      //ms, frames with this delay or shorter are displayed for WS_DEFAULT_FRAME_DELAY, as browsers do
+#define WS_DEFAULT_FRAME_DELAY 100 //ms
+#define WS_MAX_FRAME_DELAY 655350 //ms, longer delays are displayed this long (the longest GIF delay)
+#define WS_MAX_COALESCED_FRAMES 16 //a playback fallen behind more frames than this restarts its timeline instead of catching up
+#define WS_RED_MA   16 //current draw of a channel at full level
+#define WS_GREEN_MA 11
+#define WS_BLUE_MA  15
+#define WS_DARK_MA  1  //current draw of an unlit LED
+#define WS_TRANSITION_PATTERN transition_fade //transition between images by default
+#define WS_TRANSITION_MS 300       //default duration of a transition
+#define WS_MAX_TRANSITION_MS 10000
+#define WS_TRANSITION_INTERVAL 20  //ms, render period during a transition
+#define WS_WIPE_EDGE 64            //width of the soft edge of the wipes, the keys of the pixels are 0..255
 
 namespace pixelbox
 {
   namespace ws2812b_8x8
   {
+    typedef enum transition_e   //how the outgoing frame turns into the new content
+    {
+      transition_cut = 0,           //no transition
+      transition_fade = 1,          //cross-fade
+      transition_wipe_right = 2,    //soft edge from left to right
+      transition_wipe_down = 3,     //soft edge from top to bottom
+      transition_wipe_diagonal = 4, //soft edge from the top left corner
+      transition_dissolve = 5,      //the pixels switch in a scattered order
+    }transition_e;
+
+    typedef struct render_stats_s   //timing of the played animation, reset when an animation is set
+    {
+      uint32_t frames;       //frames rendered at their deadline
+      uint32_t coalesced;    //frames composited without being shown, the playback was behind
+      uint32_t resyncs;      //the playback was too far behind and restarted its timeline
+      uint32_t late_max_us;  //worst lateness of a frame compared to its deadline
+      uint32_t late_sum_us;  //sum of the latenesses, late_sum_us / frames is the mean
+      uint32_t jitter_us;    //smoothed change of the lateness between frames
+      uint32_t played_ms;    //sum of the (clamped) delays of the rendered frames, the animation's own time
+      uint32_t elapsed_ms;   //wall time since the first frame, equals played_ms (minus the current frame's delay) if nothing drifts
+    }render_stats_s;
+
     //set data to be displayed
     void set(CRGB *in); //set image 
-    void set(anim::animation_s* anim); //set animation
+    void set(anim::animation_s* anim); //set animation, its slab is moved into the renderer and anim is left empty
+    void set(anim::frame_source_s* source); //set frame by frame decoded animation
     void set_color(CRGB color); //set color
+    CRGB* begin_image(); //stop the displayed content (its last frame stays displayed) and get the buffer to draw an image into
+    void show_image();   //display the image drawn into the buffer
 
     //set display parameters
     void set_brightness(uint8_t value);
     void set_brightness_percent(uint8_t percent);
+    void set_color_correction(CRGB correction); //white point calibration, 0xFFFFFF is uncorrected
+    void set_dither(bool on); //temporal dithering of the dark shades, the LEDs are refreshed on every render while it's on
+    void set_transition(uint8_t pattern, uint32_t duration_ms); //transition_e of the next content switches, 0 ms cuts
     void set_max_current(uint32 current_ma);
     void set_enable(bool on);
+    const render_stats_s* get_render_stats();
 
     void setup();
     void loop();
@@ -23,6 +23,13 @@
  *      distribution.
  */
 
+/*
+ * Altered for PixelBox: added tinf_uncompress_stream (input refill callback,
+ * ring window output delivered through a callback), and lookup table based
+ * symbol decoding in a caller provided workspace (tinf_uncompress_ws,
+ * tinf_zlib_uncompress_ws), and tinf_crc32_update.
+ */
+
 #ifndef TINF_H_INCLUDED
 #define TINF_H_INCLUDED
 
@@ -54,6 +61,14 @@ typedef enum {
 	TINF_BUF_ERROR  = -5  /**< Not enough room for output */
 } tinf_error_code;
 
+#define TINF_FAST_BITS 9 /**< Codes up to this length are decoded by a single lookup */
+
+/**
+ * Size of the workspace holding the lookup tables of the literal/length and
+ * distance trees.
+ */
+#define TINF_WORKSPACE_SIZE (2 * (1 << TINF_FAST_BITS) * sizeof(unsigned short))
+
 /**
  * Initialize global data used by tinf.
  *
@@ -79,6 +94,74 @@ void TINFCC tinf_init(void);
 int TINFCC tinf_uncompress(void *dest, unsigned int *destLen,
                            const void *source, unsigned int sourceLen);
 
+/**
+ * Decompress like tinf_uncompress, decoding symbols with lookup tables in
+ * `workspace`.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param workspace `TINF_WORKSPACE_SIZE` bytes, aligned for unsigned short
+ * (NULL decodes bit by bit like tinf_uncompress)
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_ws(void *dest, unsigned int *destLen,
+                              const void *source, unsigned int sourceLen,
+                              void *workspace);
+
+/**
+ * Read callback of tinf_uncompress_stream, supplies the next part of the
+ * deflate data.
+ *
+ * @param user user pointer given to tinf_uncompress_stream
+ * @param data set to the next part of the compressed data, it must stay valid
+ * until the next call
+ * @param len set to the size of the next part
+ * @return non-zero if data was supplied, zero at the end of the input
+ */
+typedef int (TINFCC *tinf_read_cb)(void *user, const unsigned char **data,
+                                   unsigned int *len);
+
+/**
+ * Write callback of tinf_uncompress_stream, receives the decompressed data in
+ * order, in parts of at most `TINF_STREAM_FLUSH_SIZE` bytes.
+ *
+ * @param user user pointer given to tinf_uncompress_stream
+ * @param data pointer to decompressed data, valid during the call
+ * @param len size of decompressed data
+ * @return `TINF_OK` to continue, anything else stops decompression and is
+ * returned by tinf_uncompress_stream
+ */
+typedef int (TINFCC *tinf_write_cb)(void *user, const unsigned char *data,
+                                    unsigned int len);
+
+#define TINF_STREAM_FLUSH_SIZE 256 /**< Output is delivered at least this often */
+
+/**
+ * Decompress deflate data supplied by `read` in parts, delivering the
+ * decompressed data to `write`.
+ *
+ * Matches are resolved in `window`, a ring buffer of `windowSize` bytes that
+ * must be a power of two. Deflate data can reference up to 32 KiB back, so a
+ * smaller window is only enough if the whole decompressed data fits into it.
+ *
+ * @param window pointer to the ring buffer used as history
+ * @param windowSize size of `window`, power of two
+ * @param read callback supplying the compressed data
+ * @param write callback receiving the decompressed data
+ * @param user pointer passed to the callbacks
+ * @param destLen set to the size of the decompressed data on success (can be
+ * NULL)
+ * @param workspace `TINF_WORKSPACE_SIZE` bytes for the lookup tables, aligned
+ * for unsigned short (NULL decodes bit by bit)
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_uncompress_stream(void *window, unsigned int windowSize,
+                                  tinf_read_cb read, tinf_write_cb write,
+                                  void *user, unsigned int *destLen,
+                                  void *workspace);
+
 /**
  * Decompress `sourceLen` bytes of gzip data from `source` to `dest`.
  *
@@ -115,6 +198,22 @@ int TINFCC tinf_gzip_uncompress(void *dest, unsigned int *destLen,
 int TINFCC tinf_zlib_uncompress(void *dest, unsigned int *destLen,
                                 const void *source, unsigned int sourceLen);
 
+/**
+ * Decompress zlib data like tinf_zlib_uncompress, decoding symbols with
+ * lookup tables in `workspace`.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param workspace `TINF_WORKSPACE_SIZE` bytes, aligned for unsigned short
+ * (NULL decodes bit by bit)
+ * @return `TINF_OK` on success, error code on error
+ */
+int TINFCC tinf_zlib_uncompress_ws(void *dest, unsigned int *destLen,
+                                   const void *source, unsigned int sourceLen,
+                                   void *workspace);
+
 /**
  * Compute Adler-32 checksum of `length` bytes starting at `data`.
  *
@@ -133,6 +232,18 @@ unsigned int TINFCC tinf_adler32(const void *data, unsigned int length);
  */
 unsigned int TINFCC tinf_crc32(const void *data, unsigned int length);
 
+/**
+ * Continue the CRC32 checksum `crc` of the preceding data with `length` bytes
+ * starting at `data`.
+ *
+ * @param crc CRC32 checksum of the preceding data, 0 for none
+ * @param data pointer to data
+ * @param length size of data
+ * @return CRC32 checksum of the preceding data and `data`
+ */
+unsigned int TINFCC tinf_crc32_update(unsigned int crc, const void *data,
+                                      unsigned int length);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
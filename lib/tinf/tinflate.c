@@ -23,10 +23,20 @@
  *      distribution.
  */
 
+/*
+ * Altered for PixelBox: the output is addressed through a window mask, so the
+ * same decoder writes either the whole output buffer or a ring window that is
+ * flushed to a callback (tinf_uncompress_stream), and the input can be
+ * refilled from a callback. Symbols are decoded with first level lookup
+ * tables kept in a caller provided workspace, the bit buffer is refilled
+ * 32 bits at a time.
+ */
+
 #include "tinf.h"
 
 #include <assert.h>
 #include <limits.h>
+#include <stddef.h>
 
 #if defined(UINT_MAX) && (UINT_MAX) < 0xFFFFFFFFUL
 #  error "tinf requires unsigned int to be at least 32-bit"
@@ -46,22 +56,34 @@ struct tinf_data {
 	unsigned int tag;
 	int bitcount;
 	int overflow;
+	tinf_read_cb read; /* Refills source, NULL if source is everything */
+	void *user;
 
-	unsigned char *dest_start;
-	unsigned char *dest;
-	unsigned char *dest_end;
+	unsigned char *window; /* Whole output or ring window */
+	unsigned int mask;     /* Window size - 1, all ones for whole output */
+	unsigned int pos;      /* Bytes decompressed so far */
+	unsigned int pos_end;  /* Output limit */
+	unsigned int flushed;  /* Bytes delivered to write */
+	unsigned int flush_size; /* Deliver output when this many bytes are pending */
+	tinf_write_cb write;
 
 	struct tinf_tree ltree; /* Literal/length tree */
 	struct tinf_tree dtree; /* Distance tree */
+	unsigned short *lfast;  /* Lookup table of ltree, NULL without workspace */
+	unsigned short *dfast;  /* Lookup table of dtree, NULL without workspace */
 };
 
-/* -- Utility functions -- */
+/*
+ * A lookup table is indexed by the next TINF_FAST_BITS bits of input, an
+ * entry holds the symbol and the length of its code, or zero if the code is
+ * longer than TINF_FAST_BITS.
+ */
+#define TINF_FAST_SIZE (1 << TINF_FAST_BITS)
+#define TINF_FAST_ENTRY(sym, len) ((unsigned short) (((len) << 9) | (sym)))
+#define TINF_FAST_SYM(e) ((e) & 0x1FF)
+#define TINF_FAST_LEN(e) ((e) >> 9)
 
-static unsigned int read_le16(const unsigned char *p)
-{
-	return ((unsigned int) p[0])
-	     | ((unsigned int) p[1] << 8);
-}
+/* -- Utility functions -- */
 
 /* Build fixed Huffman trees */
 static void tinf_build_fixed_trees(struct tinf_tree *lt, struct tinf_tree *dt)
@@ -106,9 +128,54 @@ static void tinf_build_fixed_trees(struct tinf_tree *lt, struct tinf_tree *dt)
 	dt->max_sym = 29;
 }
 
+/* Reverse the order of the lowest len bits of code */
+static unsigned int tinf_reverse_bits(unsigned int code, int len)
+{
+	unsigned int rev = 0;
+
+	while (len--) {
+		rev = (rev << 1) | (code & 1);
+		code >>= 1;
+	}
+
+	return rev;
+}
+
+/* Fill the lookup table of a tree, codes are stored bit reversed in the input */
+static void tinf_build_fast(const struct tinf_tree *t, unsigned short *fast)
+{
+	unsigned int code = 0, index = 0;
+	int len;
+
+	for (code = 0; code < TINF_FAST_SIZE; ++code) {
+		fast[code] = 0;
+	}
+
+	/*
+	 * Canonical codes of a length are consecutive, following the codes of
+	 * the previous length shifted left by one
+	 */
+	code = 0;
+
+	for (len = 1; len <= TINF_FAST_BITS; ++len) {
+		unsigned int n;
+
+		for (n = 0; n < t->counts[len]; ++n, ++code, ++index) {
+			unsigned int i;
+
+			/* Every index starting with the code decodes to its symbol */
+			for (i = tinf_reverse_bits(code, len); i < TINF_FAST_SIZE; i += 1 << len) {
+				fast[i] = TINF_FAST_ENTRY(t->symbols[index], len);
+			}
+		}
+
+		code <<= 1;
+	}
+}
+
 /* Given an array of code lengths, build a tree */
 static int tinf_build_tree(struct tinf_tree *t, const unsigned char *lengths,
-                           unsigned int num)
+                           unsigned int num, unsigned short *fast)
 {
 	unsigned short offs[16];
 	unsigned int i, num_codes, available;
@@ -170,18 +237,138 @@ static int tinf_build_tree(struct tinf_tree *t, const unsigned char *lengths,
 		t->symbols[1] = t->max_sym + 1;
 	}
 
+	if (fast != NULL) {
+		tinf_build_fast(t, fast);
+	}
+
 	return TINF_OK;
 }
 
 /* -- Decode functions -- */
 
+/* Get the next part of the input from the read callback */
+static int tinf_next_source(struct tinf_data *d)
+{
+	unsigned int len = 0;
+
+	if (d->read == NULL) {
+		return 0;
+	}
+
+	do {
+		if (!d->read(d->user, &d->source, &len)) {
+			d->source_end = d->source;
+			return 0;
+		}
+	} while (len == 0);
+
+	d->source_end = d->source + len;
+
+	return 1;
+}
+
+/* Get one byte from source stream, sets overflow at the end */
+static unsigned int tinf_getbyte(struct tinf_data *d)
+{
+	/* Whole bytes read ahead into the bit buffer come first */
+	if (d->bitcount >= 8) {
+		unsigned int c = d->tag & 0xFF;
+
+		d->tag >>= 8;
+		d->bitcount -= 8;
+
+		return c;
+	}
+
+	if (d->source == d->source_end && !tinf_next_source(d)) {
+		d->overflow = 1;
+		return 0;
+	}
+
+	return *d->source++;
+}
+
+/* Deliver the pending output to the write callback */
+static int tinf_flush(struct tinf_data *d)
+{
+	while (d->flushed != d->pos) {
+		unsigned int start = d->flushed & d->mask;
+		unsigned int len = d->pos - d->flushed;
+		int res;
+
+		/* Pending output can wrap around the end of the window */
+		if (len > d->mask - start + 1) {
+			len = d->mask - start + 1;
+		}
+
+		res = d->write(d->user, d->window + start, len);
+
+		if (res != TINF_OK) {
+			return res;
+		}
+
+		d->flushed += len;
+	}
+
+	return TINF_OK;
+}
+
+/* Put one byte of output, flushing before pending output would be overwritten */
+static int tinf_put(struct tinf_data *d, unsigned char c)
+{
+	d->window[d->pos++ & d->mask] = c;
+
+	if (d->pos - d->flushed >= d->flush_size) {
+		return tinf_flush(d);
+	}
+
+	return TINF_OK;
+}
+
+/* Fill the bit buffer with as many whole bytes as fit, never sets overflow */
+static void tinf_fill(struct tinf_data *d)
+{
+	/* Read 32 bits at once if available, taking the bytes that fit */
+	if (d->bitcount <= 24 && d->source_end - d->source >= 4) {
+		const unsigned char *p = d->source;
+		unsigned int n = (32 - d->bitcount) >> 3;
+
+		d->tag |= ((unsigned int) p[0]
+		        | ((unsigned int) p[1] << 8)
+		        | ((unsigned int) p[2] << 16)
+		        | ((unsigned int) p[3] << 24)) << d->bitcount;
+		d->source += n;
+		d->bitcount += n << 3;
+
+		/* Drop the bits of the next byte that did not fit whole */
+		if (d->bitcount < 32) {
+			d->tag &= (1UL << d->bitcount) - 1;
+		}
+
+		return;
+	}
+
+	while (d->bitcount <= 24) {
+		if (d->source == d->source_end && !tinf_next_source(d)) {
+			return;
+		}
+
+		d->tag |= (unsigned int) *d->source++ << d->bitcount;
+		d->bitcount += 8;
+	}
+}
+
 static void tinf_refill(struct tinf_data *d, int num)
 {
 	assert(num >= 0 && num <= 32);
 
+	if (d->bitcount < num) {
+		tinf_fill(d);
+	}
+
 	/* Read bytes until at least num bits available */
 	while (d->bitcount < num) {
-		if (d->source != d->source_end) {
+		if (d->source != d->source_end || tinf_next_source(d)) {
 			d->tag |= (unsigned int) *d->source++ << d->bitcount;
 		}
 		else {
@@ -241,8 +428,18 @@ static int tinf_decode_symbol(struct tinf_data *d, const struct tinf_tree *t)
 	 * falls within the leaves we are done. Otherwise we adjust the range
 	 * of offs and add one more bit to it.
 	 */
+	if (d->bitcount < 16) {
+		tinf_fill(d);
+	}
+
 	for (len = 1; ; ++len) {
-		offs = 2 * offs + tinf_getbits(d, 1);
+		if (d->bitcount == 0) {
+			tinf_refill(d, 1);
+		}
+
+		offs = 2 * offs + (d->tag & 1);
+		d->tag >>= 1;
+		d->bitcount--;
 
 		assert(len <= 15);
 
@@ -259,6 +456,31 @@ static int tinf_decode_symbol(struct tinf_data *d, const struct tinf_tree *t)
 	return t->symbols[base + offs];
 }
 
+/* Decode a symbol with the lookup table of the tree, walking the tree for long codes */
+static int tinf_decode(struct tinf_data *d, const struct tinf_tree *t,
+                       const unsigned short *fast)
+{
+	if (fast != NULL) {
+		unsigned int e;
+
+		if (d->bitcount < TINF_FAST_BITS) {
+			tinf_fill(d);
+		}
+
+		/* Near the end of the input the code is decoded bit by bit */
+		if (d->bitcount >= TINF_FAST_BITS) {
+			e = fast[d->tag & (TINF_FAST_SIZE - 1)];
+
+			if (e != 0) {
+				tinf_getbits_no_refill(d, TINF_FAST_LEN(e));
+				return TINF_FAST_SYM(e);
+			}
+		}
+	}
+
+	return tinf_decode_symbol(d, t);
+}
+
 /* Given a data stream, decode dynamic trees from it */
 static int tinf_decode_trees(struct tinf_data *d, struct tinf_tree *lt,
                              struct tinf_tree *dt)
@@ -310,7 +532,7 @@ static int tinf_decode_trees(struct tinf_data *d, struct tinf_tree *lt,
 	}
 
 	/* Build code length tree (in literal/length tree to save space) */
-	res = tinf_build_tree(lt, lengths, 19);
+	res = tinf_build_tree(lt, lengths, 19, d->lfast);
 
 	if (res != TINF_OK) {
 		return res;
@@ -323,7 +545,7 @@ static int tinf_decode_trees(struct tinf_data *d, struct tinf_tree *lt,
 
 	/* Decode code lengths for the dynamic trees */
 	for (num = 0; num < hlit + hdist; ) {
-		int sym = tinf_decode_symbol(d, lt);
+		int sym = tinf_decode(d, lt, d->lfast);
 
 		if (sym > lt->max_sym) {
 			return TINF_DATA_ERROR;
@@ -369,13 +591,13 @@ static int tinf_decode_trees(struct tinf_data *d, struct tinf_tree *lt,
 	}
 
 	/* Build dynamic trees */
-	res = tinf_build_tree(lt, lengths, hlit);
+	res = tinf_build_tree(lt, lengths, hlit, d->lfast);
 
 	if (res != TINF_OK) {
 		return res;
 	}
 
-	res = tinf_build_tree(dt, lengths + hlit, hdist);
+	res = tinf_build_tree(dt, lengths + hlit, hdist, d->dfast);
 
 	if (res != TINF_OK) {
 		return res;
@@ -417,7 +639,7 @@ static int tinf_inflate_block_data(struct tinf_data *d, struct tinf_tree *lt,
 	};
 
 	for (;;) {
-		int sym = tinf_decode_symbol(d, lt);
+		int sym = tinf_decode(d, lt, d->lfast);
 
 		/* Check for overflow in bit reader */
 		if (d->overflow) {
@@ -425,10 +647,17 @@ static int tinf_inflate_block_data(struct tinf_data *d, struct tinf_tree *lt,
 		}
 
 		if (sym < 256) {
-			if (d->dest == d->dest_end) {
+			int res;
+
+			if (d->pos == d->pos_end) {
 				return TINF_BUF_ERROR;
 			}
-			*d->dest++ = sym;
+
+			res = tinf_put(d, sym);
+
+			if (res != TINF_OK) {
+				return res;
+			}
 		}
 		else {
 			int length, dist, offs;
@@ -450,7 +679,7 @@ static int tinf_inflate_block_data(struct tinf_data *d, struct tinf_tree *lt,
 			length = tinf_getbits_base(d, length_bits[sym],
 			                           length_base[sym]);
 
-			dist = tinf_decode_symbol(d, dt);
+			dist = tinf_decode(d, dt, d->dfast);
 
 			/* Check dist is within range */
 			if (dist > dt->max_sym || dist > 29) {
@@ -461,20 +690,23 @@ static int tinf_inflate_block_data(struct tinf_data *d, struct tinf_tree *lt,
 			offs = tinf_getbits_base(d, dist_bits[dist],
 			                         dist_base[dist]);
 
-			if (offs > d->dest - d->dest_start) {
+			/* Check offs is within output and window */
+			if ((unsigned int) offs > d->pos || (unsigned int) offs - 1 > d->mask) {
 				return TINF_DATA_ERROR;
 			}
 
-			if (d->dest_end - d->dest < length) {
+			if (d->pos_end - d->pos < (unsigned int) length) {
 				return TINF_BUF_ERROR;
 			}
 
 			/* Copy match */
 			for (i = 0; i < length; ++i) {
-				d->dest[i] = d->dest[i - offs];
-			}
+				int res = tinf_put(d, d->window[(d->pos - offs) & d->mask]);
 
-			d->dest += length;
+				if (res != TINF_OK) {
+					return res;
+				}
+			}
 		}
 	}
 }
@@ -484,39 +716,49 @@ static int tinf_inflate_uncompressed_block(struct tinf_data *d)
 {
 	unsigned int length, invlength;
 
-	if (d->source_end - d->source < 4) {
-		return TINF_DATA_ERROR;
-	}
+	/* Skip to the byte boundary, whole bytes left in the bit buffer are read first */
+	tinf_getbits_no_refill(d, d->bitcount & 7);
 
 	/* Get length */
-	length = read_le16(d->source);
+	length = tinf_getbyte(d);
+	length |= tinf_getbyte(d) << 8;
 
 	/* Get one's complement of length */
-	invlength = read_le16(d->source + 2);
+	invlength = tinf_getbyte(d);
+	invlength |= tinf_getbyte(d) << 8;
+
+	if (d->overflow) {
+		return TINF_DATA_ERROR;
+	}
 
 	/* Check length */
 	if (length != (~invlength & 0x0000FFFF)) {
 		return TINF_DATA_ERROR;
 	}
 
-	d->source += 4;
-
-	if (d->source_end - d->source < length) {
+	if (d->read == NULL && (unsigned int) (d->source_end - d->source) + (d->bitcount >> 3) < length) {
 		return TINF_DATA_ERROR;
 	}
 
-	if (d->dest_end - d->dest < length) {
+	if (d->pos_end - d->pos < length) {
 		return TINF_BUF_ERROR;
 	}
 
 	/* Copy block */
 	while (length--) {
-		*d->dest++ = *d->source++;
-	}
+		unsigned int c = tinf_getbyte(d);
+		int res;
+
+		if (d->overflow) {
+			return TINF_DATA_ERROR;
+		}
 
-	/* Make sure we start next block on a byte boundary */
-	d->tag = 0;
-	d->bitcount = 0;
+		res = tinf_put(d, c);
+
+		if (res != TINF_OK) {
+			return res;
+		}
+	}
 
 	return TINF_OK;
 }
@@ -527,6 +769,11 @@ static int tinf_inflate_fixed_block(struct tinf_data *d)
 	/* Build fixed Huffman trees */
 	tinf_build_fixed_trees(&d->ltree, &d->dtree);
 
+	if (d->lfast != NULL) {
+		tinf_build_fast(&d->ltree, d->lfast);
+		tinf_build_fast(&d->dtree, d->dfast);
+	}
+
 	/* Decode block using fixed trees */
 	return tinf_inflate_block_data(d, &d->ltree, &d->dtree);
 }
@@ -553,47 +800,34 @@ void tinf_init(void)
 	return;
 }
 
-/* Inflate stream from source to dest */
-int tinf_uncompress(void *dest, unsigned int *destLen,
-                    const void *source, unsigned int sourceLen)
+/* Inflate blocks until the final one */
+static int tinf_inflate(struct tinf_data *d)
 {
-	struct tinf_data d;
 	int bfinal;
 
-	/* Initialise data */
-	d.source = (const unsigned char *) source;
-	d.source_end = d.source + sourceLen;
-	d.tag = 0;
-	d.bitcount = 0;
-	d.overflow = 0;
-
-	d.dest = (unsigned char *) dest;
-	d.dest_start = d.dest;
-	d.dest_end = d.dest + *destLen;
-
 	do {
 		unsigned int btype;
 		int res;
 
 		/* Read final block flag */
-		bfinal = tinf_getbits(&d, 1);
+		bfinal = tinf_getbits(d, 1);
 
 		/* Read block type (2 bits) */
-		btype = tinf_getbits(&d, 2);
+		btype = tinf_getbits(d, 2);
 
 		/* Decompress block */
 		switch (btype) {
 		case 0:
 			/* Decompress uncompressed block */
-			res = tinf_inflate_uncompressed_block(&d);
+			res = tinf_inflate_uncompressed_block(d);
 			break;
 		case 1:
 			/* Decompress block with fixed Huffman trees */
-			res = tinf_inflate_fixed_block(&d);
+			res = tinf_inflate_fixed_block(d);
 			break;
 		case 2:
 			/* Decompress block with dynamic Huffman trees */
-			res = tinf_inflate_dynamic_block(&d);
+			res = tinf_inflate_dynamic_block(d);
 			break;
 		default:
 			res = TINF_DATA_ERROR;
@@ -606,11 +840,116 @@ int tinf_uncompress(void *dest, unsigned int *destLen,
 	} while (!bfinal);
 
 	/* Check for overflow in bit reader */
-	if (d.overflow) {
+	if (d->overflow) {
 		return TINF_DATA_ERROR;
 	}
 
-	*destLen = d.dest - d.dest_start;
+	return TINF_OK;
+}
+
+/* Use the lookup tables in the workspace, or walk the trees without one */
+static void tinf_set_workspace(struct tinf_data *d, void *workspace)
+{
+	d->lfast = (unsigned short *) workspace;
+	d->dfast = workspace != NULL ? d->lfast + TINF_FAST_SIZE : NULL;
+}
+
+/* Inflate stream from source to dest */
+int tinf_uncompress(void *dest, unsigned int *destLen,
+                    const void *source, unsigned int sourceLen)
+{
+	return tinf_uncompress_ws(dest, destLen, source, sourceLen, NULL);
+}
+
+/* Inflate stream from source to dest with lookup tables in workspace */
+int tinf_uncompress_ws(void *dest, unsigned int *destLen,
+                       const void *source, unsigned int sourceLen,
+                       void *workspace)
+{
+	struct tinf_data d;
+	int res;
+
+	/* Initialise data */
+	d.source = (const unsigned char *) source;
+	d.source_end = d.source + sourceLen;
+	d.tag = 0;
+	d.bitcount = 0;
+	d.overflow = 0;
+	d.read = NULL;
+	d.user = NULL;
+
+	/* The whole output is the window, nothing is flushed */
+	d.window = (unsigned char *) dest;
+	d.mask = 0xFFFFFFFFUL;
+	d.pos = 0;
+	d.pos_end = *destLen;
+	d.flushed = 0;
+	d.flush_size = 0xFFFFFFFFUL;
+	d.write = NULL;
+
+	tinf_set_workspace(&d, workspace);
+
+	res = tinf_inflate(&d);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	*destLen = d.pos;
+
+	return TINF_OK;
+}
+
+/* Inflate stream from read callback to write callback through a ring window */
+int tinf_uncompress_stream(void *window, unsigned int windowSize,
+                           tinf_read_cb read, tinf_write_cb write,
+                           void *user, unsigned int *destLen,
+                           void *workspace)
+{
+	struct tinf_data d;
+	int res;
+
+	if (window == NULL || read == NULL || write == NULL) {
+		return TINF_BUF_ERROR;
+	}
+
+	/* Window size must be a power of two */
+	if (windowSize == 0 || (windowSize & (windowSize - 1)) != 0) {
+		return TINF_BUF_ERROR;
+	}
+
+	/* Initialise data, the source is filled on the first read */
+	d.source = NULL;
+	d.source_end = NULL;
+	d.tag = 0;
+	d.bitcount = 0;
+	d.overflow = 0;
+	d.read = read;
+	d.user = user;
+
+	d.window = (unsigned char *) window;
+	d.mask = windowSize - 1;
+	d.pos = 0;
+	d.pos_end = 0xFFFFFFFFUL;
+	d.flushed = 0;
+	d.flush_size = windowSize < TINF_STREAM_FLUSH_SIZE ? windowSize : TINF_STREAM_FLUSH_SIZE;
+	d.write = write;
+
+	tinf_set_workspace(&d, workspace);
+
+	res = tinf_inflate(&d);
+
+	if (res == TINF_OK) {
+		res = tinf_flush(&d);
+	}
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	if (destLen != NULL) {
+		*destLen = d.pos;
+	}
 
 	return TINF_OK;
 }
@@ -23,8 +23,14 @@
  *      distribution.
  */
 
+/*
+ * Altered for PixelBox: added tinf_zlib_uncompress_ws.
+ */
+
 #include "tinf.h"
 
+#include <stddef.h>
+
 static unsigned int read_be32(const unsigned char *p)
 {
 	return ((unsigned int) p[0] << 24)
@@ -35,6 +41,13 @@ static unsigned int read_be32(const unsigned char *p)
 
 int tinf_zlib_uncompress(void *dest, unsigned int *destLen,
                          const void *source, unsigned int sourceLen)
+{
+	return tinf_zlib_uncompress_ws(dest, destLen, source, sourceLen, NULL);
+}
+
+int tinf_zlib_uncompress_ws(void *dest, unsigned int *destLen,
+                            const void *source, unsigned int sourceLen,
+                            void *workspace)
 {
 	const unsigned char *src = (const unsigned char *) source;
 	unsigned char *dst = (unsigned char *) dest;
@@ -79,7 +92,7 @@ int tinf_zlib_uncompress(void *dest, unsigned int *destLen,
 
 	/* -- Decompress data -- */
 
-	res = tinf_uncompress(dst, destLen, src + 2, sourceLen - 6);
+	res = tinf_uncompress_ws(dst, destLen, src + 2, sourceLen - 6, workspace);
 
 	if (res != TINF_OK) {
 		return TINF_DATA_ERROR;
@@ -1,40 +1,139 @@
 #include "anim.hpp"
 #include <FastLED.h>
+#include "color.hpp"
 
 namespace pixelbox
 {
   namespace anim
   {    
-    bool add_frame(animation_s* anim, uint32_t delay_ms, uint32_t x, uint32_t y, CRGB* pixels, uint32_t pixels_size)
+    static uint32_t align_size(uint32_t size) //frame data blocks are 4 byte aligned in the slab
     {
-      if(!anim) return false;
+      return (size + 3) & ~3u;
+    }
+
+    static void rebase(void* pointer_pt, uintptr_t old_data, uint8_t* new_data) //move a pointer into the slab's data area after the slab moved
+    {
+      uint8_t** pointer = (uint8_t**)pointer_pt;
+      if(*pointer) *pointer = new_data + ((uintptr_t)*pointer - old_data);
+    }
 
-      //alloc memory for frame data if necessary
-      if(anim->frames == NULL)
+    static void rebase_frames(frame_s* frames, uint32_t frames_size, uintptr_t old_data, uint8_t* new_data) //frame data pointers follow the moved data
+    {
+      for(uint32_t i = 0; i < frames_size; i++)
       {
-        anim->frames = (frame_s*)calloc(FRAME_ALLOCATION_SIZE, sizeof(frame_s));
-        if(anim->frames == NULL) return false;
-        anim->frames_size = 0;
-        anim->frames_allocated = FRAME_ALLOCATION_SIZE;
+        frame_s* frame = &frames[i];
+        rebase(&frame->pixels, old_data, new_data);
+        rebase(&frame->indices, old_data, new_data);
+        rebase(&frame->palette, old_data, new_data);
+        rebase(&frame->mask, old_data, new_data);
+        rebase(&frame->runs, old_data, new_data);
+        rebase(&frame->run_colors, old_data, new_data);
+        rebase(&frame->run_indices, old_data, new_data);
       }
+    }
+
+    static void move_data(animation_s* anim, uint32_t frames_allocated) //move the frame data right after a shorter frame array, inside the slab
+    {
+      uint8_t* data = (uint8_t*)(anim->frames + frames_allocated);
+      memmove(data, anim->data, anim->data_size);
+      rebase_frames(anim->frames, anim->frames_size, (uintptr_t)anim->data, data);
+      anim->data = data;
+      anim->frames_allocated = frames_allocated;
+    }
+
+    static bool resize_slab(animation_s* anim, uint32_t frames_allocated, uint32_t data_allocated)
+    {
+      //the slab holds the frame array followed by the frame data, the data of a shrinking frame array moves down before the slab is cut
+      if(frames_allocated < anim->frames_allocated) move_data(anim, frames_allocated);
+      uintptr_t old_data = (uintptr_t)anim->data;
+      uint32_t old_frames_allocated = anim->frames_allocated;
+      frame_s* slab = (frame_s*)realloc(anim->frames, frames_allocated * sizeof(frame_s) + data_allocated);
+      if(slab == NULL) return false;
+      uint8_t* data = (uint8_t*)(slab + frames_allocated);
+      memmove(data, slab + old_frames_allocated, anim->data_size);
+      rebase_frames(slab, anim->frames_size, old_data, data);
+
+      anim->frames = slab;
+      anim->frames_allocated = frames_allocated;
+      anim->data = data;
+      anim->data_allocated = data_allocated;
+      return true;
+    }
 
-      if(anim->frames_size == anim->frames_allocated)
+    static bool grow(animation_s* anim, uint32_t frames, uint32_t bytes) //make room for more frames and data, doubling the capacity if the size was not preflighted
+    {
+      uint32_t frames_allocated = anim->frames_allocated;
+      uint32_t data_allocated = anim->data_allocated;
+      if(anim->frames_size + frames <= frames_allocated && anim->data_size + bytes <= data_allocated) return true;
+
+      if(anim->frames_size + frames > frames_allocated)
+      {
+        frames_allocated = frames_allocated ? frames_allocated * 2 : FRAME_ALLOCATION_SIZE;
+        if(frames_allocated < anim->frames_size + frames) frames_allocated = anim->frames_size + frames;
+      }
+      if(anim->data_size + bytes > data_allocated)
       {
-        anim->frames = (frame_s*)realloc(anim->frames, anim->frames_allocated + FRAME_ALLOCATION_SIZE * sizeof(frame_s));
-        if(anim->frames == NULL) return false;
-        memset(anim->frames + anim->frames_size, 0, FRAME_ALLOCATION_SIZE * sizeof(frame_s));
-        anim->frames_allocated += FRAME_ALLOCATION_SIZE;
+        data_allocated = data_allocated ? data_allocated * 2 : FRAME_DATA_ALLOCATION_SIZE;
+        if(data_allocated < anim->data_size + bytes) data_allocated = anim->data_size + bytes;
       }
+      return resize_slab(anim, frames_allocated, data_allocated);
+    }
+
+    static void* alloc_data(animation_s* anim, uint32_t size) //take a block from the slab's data area, the room has to be there
+    {
+      uint8_t* block = anim->data + anim->data_size;
+      anim->data_size += align_size(size);
+      return block;
+    }
+
+    static uint32_t frame_data_size(const frame_s* frame) //data add_frame stores for the frame
+    {
+      uint32_t size = align_size(frame->pixels_size * sizeof(CRGB));
+      if(frame->mask) size += align_size((frame->pixels_size + 7) / 8);
+      return size;
+    }
+
+    bool animation_reserve(animation_s* anim, uint32_t frames, uint32_t bytes)
+    {
+      if(!anim) return false;
+      if(anim->frames_size + frames <= anim->frames_allocated && anim->data_size + bytes <= anim->data_allocated) return true;
+
+      //exact size, so a preflighted animation is a single allocation without slack
+      uint32_t frames_allocated = anim->frames_size + frames > anim->frames_allocated ? anim->frames_size + frames : anim->frames_allocated;
+      uint32_t data_allocated = anim->data_size + bytes > anim->data_allocated ? anim->data_size + bytes : anim->data_allocated;
+      return resize_slab(anim, frames_allocated, data_allocated);
+    }
+
+    void animation_shrink(animation_s* anim)
+    {
+      if(!anim || !anim->frames_size || (anim->frames_size == anim->frames_allocated && anim->data_size == anim->data_allocated)) return;
+      resize_slab(anim, anim->frames_size, anim->data_size); //if realloc fails the bigger slab stays valid
+    }
 
-      //copy frame data
+    bool add_frame(animation_s* anim, const frame_s* frame)
+    {
+      if(!anim || !frame || !frame->pixels) return false;
+      if(frame->pixels_size != frame->width * frame->height) return false;
+      if(!grow(anim, 1, frame_data_size(frame))) return false;
+
+      //copy frame data into the slab
       frame_s* new_frame = &anim->frames[anim->frames_size];
-      new_frame->delay_ms = delay_ms;
-      new_frame->x = x;
-      new_frame->y = y;
-      new_frame->pixels = (CRGB*) calloc(pixels_size, sizeof(CRGB));
-      if(new_frame->pixels == NULL) return false;
-      memcpy(new_frame->pixels, pixels, pixels_size * sizeof(CRGB));
-      new_frame->pixels_size = pixels_size;
+      *new_frame = *frame;
+      new_frame->indices = NULL;
+      new_frame->palette = NULL;
+      new_frame->palette_size = 0;
+      new_frame->mask = NULL;
+      new_frame->runs = NULL;
+      new_frame->runs_size = 0;
+      new_frame->run_colors = NULL;
+      new_frame->run_indices = NULL;
+      new_frame->pixels = (CRGB*)alloc_data(anim, frame->pixels_size * sizeof(CRGB));
+      memcpy(new_frame->pixels, frame->pixels, frame->pixels_size * sizeof(CRGB));
+      if(frame->mask)
+      {
+        new_frame->mask = (uint8_t*)alloc_data(anim, (frame->pixels_size + 7) / 8);
+        memcpy(new_frame->mask, frame->mask, (frame->pixels_size + 7) / 8);
+      }
       
       //update frames size
       anim->frames_size++;
@@ -45,18 +144,320 @@ namespace pixelbox
     bool animation_init(animation_s* anim)
     {
       if(!anim) return false;
-      if(anim->frames_size == 0) return true;
-      
-      //dealloc every frames' pixel buffer
-      for(uint32_t i = 0; i < anim->frames_size; i++)
-        if(anim->frames[i].pixels != NULL) free(anim->frames[i].pixels);
 
-      //dealloc frame array
-      free(anim->frames);
+      //frames and their data are in one slab
+      if(anim->frames != NULL) free(anim->frames);
 
       //zero the rest
       memset(anim, 0, sizeof(animation_s));
       return true;
     }    
+
+    void animation_move(animation_s* dst, animation_s* src)
+    {
+      if(!dst || !src || dst == src) return;
+      animation_init(dst);
+      *dst = *src;
+      memset(src, 0, sizeof(animation_s));
+    }
+
+    bool animation_copy(animation_s* dst, const animation_s* src)
+    {
+      if(!dst || !src || dst == src) return false;
+      animation_init(dst);
+      if(!src->frames_size) return true;
+
+      //exact size slab, the copy has no room to grow
+      frame_s* slab = (frame_s*)malloc(src->frames_size * sizeof(frame_s) + src->data_size);
+      if(slab == NULL) return false;
+      uint8_t* data = (uint8_t*)(slab + src->frames_size);
+      memcpy(slab, src->frames, src->frames_size * sizeof(frame_s));
+      memcpy(data, src->data, src->data_size);
+      rebase_frames(slab, src->frames_size, (uintptr_t)src->data, data);
+
+      dst->frames = slab;
+      dst->frames_size = src->frames_size;
+      dst->frames_allocated = src->frames_size;
+      dst->data = data;
+      dst->data_size = src->data_size;
+      dst->data_allocated = src->data_size;
+      return true;
+    }
+
+    void animation_clear(animation_s* anim)
+    {
+      if(!anim) return;
+      anim->frames_size = 0;
+      anim->frame_index = 0;
+      anim->data_size = 0;
+    }
+
+    static uint32_t run_end(const CRGB* next, const CRGB* prev, uint32_t start, uint32_t size, bool keyframe) //end of the run of changed pixels starting at start
+    {
+      if(keyframe) return size;
+
+      //single unchanged pixels are merged into the run (3 bytes are cheaper than a new run header)
+      uint32_t end = start + 1;
+      while(end < size && (next[end] != prev[end] || (end + 1 < size && next[end + 1] != prev[end + 1]))) end++;
+      return end;
+    }
+
+    bool delta_encoder_init(delta_encoder_s* encoder, uint32_t width, uint32_t height)
+    {
+      if(!encoder) return false;
+      memset(encoder, 0, sizeof(delta_encoder_s));
+      if(width * height == 0 || width * height > 0xFFFF) return false; //runs address the canvas with 16 bits
+      encoder->width = width;
+      encoder->height = height;
+
+      //one block for the three canvases and the palette
+      encoder->buffer = (CRGB*)calloc(width * height * 3 + DELTA_PALETTE_SIZE, sizeof(CRGB));
+      if(encoder->buffer == NULL) return false;
+      encoder->canvas = encoder->buffer;
+      encoder->next = encoder->canvas + width * height;
+      encoder->saved = encoder->next + width * height;
+      encoder->palette = encoder->saved + width * height;
+      encoder->indexed = true;
+      return true;
+    }
+
+    void delta_encoder_deinit(delta_encoder_s* encoder)
+    {
+      if(!encoder) return;
+      if(encoder->buffer) free(encoder->buffer);
+      memset(encoder, 0, sizeof(delta_encoder_s));
+    }
+
+    const CRGB* begin_delta_frame(delta_encoder_s* encoder)
+    {
+      if(!encoder || !encoder->canvas) return NULL;
+
+      //the last frame's disposal, like the renderer does it before drawing the next frame
+      if(!encoder->next_begun)
+      {
+        memcpy(encoder->next, encoder->canvas, encoder->width * encoder->height * sizeof(CRGB));
+        if(encoder->last_disposal == disposal_background)
+          fill_rect(encoder->next, encoder->width, encoder->height, encoder->last_x, encoder->last_y, encoder->last_width, encoder->last_height, CRGB::Black);
+        else if(encoder->last_disposal == disposal_previous)
+          copy_rect(encoder->next, encoder->saved, encoder->width, encoder->height, encoder->last_x, encoder->last_y, encoder->last_width, encoder->last_height);
+        encoder->next_begun = true;
+      }
+      return encoder->next;
+    }
+
+    static int32_t palette_index(delta_encoder_s* encoder, CRGB color) //index of the color in the shared palette, a new color is appended, -1 if the palette is full
+    {
+      if(encoder->palette_hit < encoder->palette_size && encoder->palette[encoder->palette_hit] == color) return encoder->palette_hit;
+      for(uint32_t i = 0; i < encoder->palette_size; i++)
+      {
+        if(encoder->palette[i] != color) continue;
+        encoder->palette_hit = i;
+        return i;
+      }
+      if(encoder->palette_size == DELTA_PALETTE_SIZE) return -1;
+      encoder->palette[encoder->palette_size] = color;
+      encoder->palette_hit = encoder->palette_size++;
+      return encoder->palette_hit;
+    }
+
+    bool add_delta_frame(animation_s* anim, delta_encoder_s* encoder, const frame_s* frame)
+    {
+      if(!anim || !encoder || !encoder->canvas || !frame) return false;
+      uint32_t size = encoder->width * encoder->height;
+
+      //composite the frame the same way the renderer would: last frame's disposal (unless begun already), then the frame itself
+      begin_delta_frame(encoder);
+      CRGB* next = encoder->next;
+      if(frame->disposal == disposal_previous)
+        copy_rect(encoder->saved, next, encoder->width, encoder->height, frame->x, frame->y, frame->width, frame->height);
+      blit(frame, next, encoder->width, encoder->height);
+
+      //keyframes hold the whole canvas, so playback can restart there without the previous frames
+      bool keyframe = encoder->frames_count % DELTA_KEYFRAME_INTERVAL == 0;
+
+      //count the runs of changed pixels, their colors are added to the palette while it holds every color of the animation
+      uint32_t palette_size = encoder->palette_size;
+      uint32_t runs_size = 0, colors_size = 0;
+      for(uint32_t i = 0; i < size; )
+      {
+        if(!keyframe && next[i] == encoder->canvas[i]) { i++; continue; }
+        uint32_t end = run_end(next, encoder->canvas, i, size, keyframe);
+        for(uint32_t p = i; encoder->indexed && p < end; p++)
+          encoder->indexed = palette_index(encoder, next[p]) >= 0;
+        runs_size++;
+        colors_size += end - i;
+        i = end;
+      }
+
+      //a frame overflowing the palette and the later ones store CRGB colors, the indices of the earlier frames stay valid
+      if(!encoder->indexed) encoder->palette_size = palette_size;
+      uint32_t color_size = encoder->indexed ? sizeof(uint8_t) : sizeof(CRGB);
+      uint32_t data_size = runs_size ? align_size(runs_size * sizeof(delta_run_s) + colors_size * color_size) : 0;
+      if(!grow(anim, 1, data_size)) return false;
+      frame_s* new_frame = &anim->frames[anim->frames_size];
+      memset(new_frame, 0, sizeof(frame_s));
+      new_frame->delay_ms = frame->delay_ms;
+      new_frame->width = encoder->width;
+      new_frame->height = encoder->height;
+      new_frame->disposal = disposal_keep;
+      color::light(next, size, new_frame->light); //delta frames hold the whole canvas, its current draw is known from now on
+      new_frame->light_valid = true;
+      if(runs_size)
+      {
+        //runs and their colors (or palette indices) are stored in one block, the palette is stored once by delta_encoder_finish
+        new_frame->runs = (delta_run_s*)alloc_data(anim, data_size);
+        new_frame->runs_size = runs_size;
+        if(encoder->indexed) new_frame->run_indices = (uint8_t*)(new_frame->runs + runs_size);
+        else new_frame->run_colors = (CRGB*)(new_frame->runs + runs_size);
+
+        uint32_t color = 0;
+        delta_run_s* run = new_frame->runs;
+        for(uint32_t i = 0; i < size; )
+        {
+          if(!keyframe && next[i] == encoder->canvas[i]) { i++; continue; }
+          uint32_t end = run_end(next, encoder->canvas, i, size, keyframe);
+          run->offset = i;
+          run->length = end - i;
+          if(encoder->indexed)
+          {
+            for(uint32_t p = i; p < end; p++)
+              new_frame->run_indices[color++] = palette_index(encoder, next[p]);
+          }
+          else
+          {
+            memcpy(new_frame->run_colors + color, next + i, run->length * sizeof(CRGB));
+            color += run->length;
+          }
+          run++;
+          i = end;
+        }
+      }
+      anim->frames_size++;
+
+      //the composited canvas becomes the reference of the next delta
+      encoder->next = encoder->canvas;
+      encoder->canvas = next;
+      encoder->last_x = frame->x;
+      encoder->last_y = frame->y;
+      encoder->last_width = frame->width;
+      encoder->last_height = frame->height;
+      encoder->last_disposal = frame->disposal;
+      encoder->next_begun = false;
+      encoder->frames_count++;
+      return true;
+    }
+
+    bool delta_encoder_finish(animation_s* anim, delta_encoder_s* encoder)
+    {
+      if(!anim || !encoder) return false;
+      bool indexed = false;
+      for(uint32_t i = 0; i < anim->frames_size && !indexed; i++)
+        indexed = anim->frames[i].run_indices != NULL;
+      if(!indexed) return true;
+
+      //the indexed frames share one palette after their data
+      uint32_t size = encoder->palette_size * sizeof(CRGB);
+      if(!grow(anim, 0, align_size(size))) return false;
+      CRGB* palette = (CRGB*)alloc_data(anim, size);
+      memcpy(palette, encoder->palette, size);
+      for(uint32_t i = 0; i < anim->frames_size; i++)
+      {
+        frame_s* frame = &anim->frames[i];
+        if(!frame->run_indices) continue;
+        frame->palette = palette;
+        frame->palette_size = encoder->palette_size;
+      }
+      return true;
+    }
+
+    void blit(const frame_s* frame, CRGB* canvas, uint32_t canvas_width, uint32_t canvas_height)
+    {
+      if(!frame || !canvas) return;
+
+      //delta frames overwrite the changed runs of the whole canvas
+      if(frame->runs)
+      {
+        if(frame->width != canvas_width || frame->height != canvas_height) return;
+        uint32_t color = 0;
+        for(uint32_t i = 0; i < frame->runs_size; i++)
+        {
+          const delta_run_s* run = &frame->runs[i];
+          if(run->offset + run->length <= canvas_width * canvas_height)
+          {
+            //indexed runs are expanded through the shared palette, out of range indices are black
+            if(frame->run_indices)
+            {
+              for(uint32_t p = 0; p < run->length; p++)
+              {
+                uint8_t index = frame->run_indices[color + p];
+                canvas[run->offset + p] = index < frame->palette_size ? frame->palette[index] : CRGB::Black;
+              }
+            }
+            else memcpy(canvas + run->offset, frame->run_colors + color, run->length * sizeof(CRGB));
+          }
+          color += run->length;
+        }
+        return;
+      }
+      if(!frame->pixels && !(frame->indices && frame->palette)) return;
+      if(frame->x >= canvas_width || frame->y >= canvas_height) return;
+
+      //clipping
+      uint32_t width = frame->width;
+      uint32_t height = frame->height;
+      if(frame->x + width > canvas_width) width = canvas_width - frame->x;
+      if(frame->y + height > canvas_height) height = canvas_height - frame->y;
+
+      for(uint32_t row = 0; row < height; row++)
+      {
+        CRGB* dst = canvas + (frame->y + row) * canvas_width + frame->x;
+        uint32_t src_index = row * frame->width;
+
+        //indexed frames are expanded through the palette here, out of range indices are black
+        if(frame->indices)
+        {
+          for(uint32_t col = 0; col < width; col++, src_index++)
+          {
+            if(frame->mask && (frame->mask[src_index / 8] & (0x01 << (src_index % 8)))) continue;
+            uint8_t index = frame->indices[src_index];
+            dst[col] = index < frame->palette_size ? frame->palette[index] : CRGB::Black;
+          }
+          continue;
+        }
+
+        //opaque rows are copied at once
+        if(!frame->mask)
+        {
+          memcpy(dst, frame->pixels + src_index, width * sizeof(CRGB));
+          continue;
+        }
+
+        for(uint32_t col = 0; col < width; col++, src_index++)
+          if(!(frame->mask[src_index / 8] & (0x01 << (src_index % 8))))
+            dst[col] = frame->pixels[src_index];
+      }
+    }
+
+    void fill_rect(CRGB* canvas, uint32_t canvas_width, uint32_t canvas_height, uint32_t x, uint32_t y, uint32_t width, uint32_t height, CRGB color)
+    {
+      if(!canvas) return;
+      if(x >= canvas_width || y >= canvas_height) return;
+      if(x + width > canvas_width) width = canvas_width - x;
+      if(y + height > canvas_height) height = canvas_height - y;
+
+      for(uint32_t row = 0; row < height; row++)
+        fill_solid(canvas + (y + row) * canvas_width + x, width, color);
+    }
+
+    void copy_rect(CRGB* dst, const CRGB* src, uint32_t canvas_width, uint32_t canvas_height, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+    {
+      if(!dst || !src) return;
+      if(x >= canvas_width || y >= canvas_height) return;
+      if(x + width > canvas_width) width = canvas_width - x;
+      if(y + height > canvas_height) height = canvas_height - y;
+
+      for(uint32_t row = 0; row < height; row++)
+        memcpy(dst + (y + row) * canvas_width + x, src + (y + row) * canvas_width + x, width * sizeof(CRGB));
+    }
   }
 }
\ No newline at end of file
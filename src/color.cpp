@@ -0,0 +1,154 @@
+#include "color.hpp"
+
+#include <Arduino.h>
+
+namespace pixelbox
+{
+  namespace color
+  {
+    //the gamma curve is computed by the compiler, these helpers replace the math library there (exp and log of doubles by their series)
+    static constexpr double const_exp(double x)
+    {
+      //e^x = (e^(x/2^k))^(2^k), the series converges fast for |x| <= 0.5
+      int halvings = 0;
+      while(x > 0.5 || x < -0.5)
+      {
+        x /= 2;
+        halvings++;
+      }
+      double sum = 1, term = 1;
+      for(int n = 1; n < 20; n++)
+      {
+        term *= x / n;
+        sum += term;
+      }
+      while(halvings--) sum *= sum;
+      return sum;
+    }
+
+    static constexpr double const_log(double x) //x > 0
+    {
+      //ln x = 2 * atanh((x - 1) / (x + 1)) - k * ln 2 with x scaled into [0.5, 1]
+      int doublings = 0;
+      while(x < 0.5)
+      {
+        x *= 2;
+        doublings++;
+      }
+      double y = (x - 1) / (x + 1), sum = 0, term = y;
+      for(int n = 1; n < 40; n += 2)
+      {
+        sum += term / n;
+        term *= y * y;
+      }
+      return 2 * sum - doublings * 0.6931471805599453;
+    }
+
+    typedef struct gamma_table_s   //linear light of the 8 bit levels, 0.16 fixed point
+    {
+      uint16_t v[256];
+      constexpr gamma_table_s() : v()
+      {
+        for(int i = 1; i < 256; i++) v[i] = (uint16_t)(const_exp(COLOR_GAMMA * const_log(i / 255.0)) * 65535 + 0.5);
+      }
+    }gamma_table_s;
+
+    static constexpr gamma_table_s gamma_table PROGMEM = gamma_table_s(); //in flash, only read when the tables are rebuilt
+
+    color_lut_s lut;                  //tables of the output
+    uint8_t brightness = 255;
+    CRGB correction = CRGB(COLOR_CORRECTION);
+    bool dither = COLOR_DITHER;
+    uint8_t dither_frame = 0;         //position in the dither sequence
+
+    static void build_channel(uint16_t* table, uint8_t scale)
+    {
+      //scale is applied in linear light, so dimming keeps the shades' ratios
+      uint32_t factor = (uint32_t)scale * brightness; //0..255*255
+      for(uint32_t i = 0; i < 256; i++)
+      {
+        //0.16 linear light * factor to 8.8 levels, full scale is exactly 255.0
+        uint32_t level = ((uint64_t)pgm_read_word(&gamma_table.v[i]) * factor * (255 << 8) + 65535ull * 65025 / 2) / (65535ull * 65025);
+        //without dithering a lit input stays lit (like FastLED's video scaling), otherwise the dark shades would be crushed to black
+        if(!dither && i && factor && level < 0x80) level = 0x80;
+        table[i] = level;
+      }
+    }
+
+    static void build()
+    {
+      build_channel(lut.r, correction.r);
+      build_channel(lut.g, correction.g);
+      build_channel(lut.b, correction.b);
+    }
+
+    void set_brightness(uint8_t value)
+    {
+      brightness = value;
+      build();
+    }
+
+    void set_correction(CRGB value)
+    {
+      correction = value;
+      build();
+    }
+
+    void set_dither(bool on)
+    {
+      dither = on;
+      build();
+    }
+
+    bool dithering()
+    {
+      return dither;
+    }
+
+    uint8_t get_brightness()
+    {
+      return brightness;
+    }
+
+    CRGB get_correction()
+    {
+      return correction;
+    }
+
+    void light(const CRGB* pixels, uint32_t size, uint32_t* sums)
+    {
+      sums[0] = sums[1] = sums[2] = 0;
+      for(uint32_t i = 0; i < size; i++)
+      {
+        sums[0] += pgm_read_word(&gamma_table.v[pixels[i].r]) >> 8;
+        sums[1] += pgm_read_word(&gamma_table.v[pixels[i].g]) >> 8;
+        sums[2] += pgm_read_word(&gamma_table.v[pixels[i].b]) >> 8;
+      }
+    }
+
+    void apply(const CRGB* in, CRGB* out, uint32_t size)
+    {
+      if(!dither)
+      {
+        for(uint32_t i = 0; i < size; i++)
+        {
+          out[i].r = (lut.r[in[i].r] + 0x80) >> 8;
+          out[i].g = (lut.g[in[i].g] + 0x80) >> 8;
+          out[i].b = (lut.b[in[i].b] + 0x80) >> 8;
+        }
+        return;
+      }
+
+      //the threshold of a pixel walks through all 256 values over the frames (odd step), neighbours are offset so they don't blink together
+      uint8_t threshold = dither_frame;
+      dither_frame += 0x9F;
+      for(uint32_t i = 0; i < size; i++)
+      {
+        out[i].r = (lut.r[in[i].r] + threshold) >> 8;
+        out[i].g = (lut.g[in[i].g] + threshold) >> 8;
+        out[i].b = (lut.b[in[i].b] + threshold) >> 8;
+        threshold += 0x35;
+      }
+    }
+  }
+}
@@ -0,0 +1,44 @@
+#include "decoder.hpp"
+
+namespace pixelbox
+{
+  namespace decoder
+  {
+    decoder_s* decoders = NULL; //registered formats, zero initialized before any registration runs
+
+    bool register_decoder(decoder_s* decoder)
+    {
+      if(decoder == NULL || decoder->probe == NULL || decoder->decode == NULL) return false;
+      decoder->next = decoders;
+      decoders = decoder;
+      return true;
+    }
+
+    const decoder_s* find_decoder(const uint8_t* header, uint32_t len)
+    {
+      for(const decoder_s* decoder = decoders; decoder; decoder = decoder->next)
+        if(decoder->probe(header, len)) return decoder;
+      return NULL;
+    }
+
+    bool decode(const String& filename, File& file, const sink_s* sink)
+    {
+      //sniff the format from the magic bytes, the file name can lie
+      uint8_t header[DECODER_PROBE_SIZE];
+      uint32_t len = file.read(header, sizeof(header));
+      const decoder_s* decoder = find_decoder(header, len);
+      if(decoder == NULL || !file.seek(0))
+      {
+        file.close();
+        return false;
+      }
+      return decoder->decode(filename, file, sink);
+    }
+
+    void stop()
+    {
+      for(const decoder_s* decoder = decoders; decoder; decoder = decoder->next)
+        if(decoder->stop) decoder->stop();
+    }
+  }
+}
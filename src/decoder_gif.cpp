@@ -0,0 +1,169 @@
+#include "decoder.hpp"
+
+#include "gif_parse.hpp"
+
+namespace pixelbox
+{
+  namespace decoder
+  {
+    img_parse::gif_parse_context_s gif;    //GIF decoded frame by frame during playback
+    File gif_file;                         //opened file of the frame by frame decoded GIF
+    bool gif_loop;                         //the frame source repeats the GIF (see sink_s::loop)
+
+    static bool probe_gif(const uint8_t* header, uint32_t len)
+    {
+      //ASCII 'GIF87a' or 'GIF89a'
+      return len >= 6 && memcmp(header, "GIF8", 4) == 0 && (header[4] == '7' || header[4] == '9') && header[5] == 'a';
+    }
+
+    static uint32_t read_file(void* user, uint8_t* buffer, uint32_t len) //byte source of the GIF parser
+    {
+      return ((File*)user)->read(buffer, len);
+    }
+
+    static bool seek_file(void* user, uint32_t position) //rewinding the GIF parser's byte source
+    {
+      return ((File*)user)->seek(position);
+    }
+
+    static void close_gif()
+    {
+      if(gif_file) gif_file.close();
+      img_parse::deinit(gif);
+    }
+
+    static void image_to_frame(img_parse::gif_parse_context_s& ctx, img_parse::image_s* image, pixelbox::anim::frame_s* frame) //describe a decoded GIF image as an animation frame
+    {
+      frame->delay_ms = image->gce.valid ? image->gce.delay_time_10ms * 10 : 0;
+      frame->x = image->id.left_position;
+      frame->y = image->id.top_position;
+      frame->width = image->id.width;
+      frame->height = image->id.height;
+      frame->disposal = image->gce.valid && image->gce.fields.disposal_method <= pixelbox::anim::disposal_previous ? (pixelbox::anim::disposal_e)image->gce.fields.disposal_method : pixelbox::anim::disposal_none;
+      frame->pixels = (CRGB*)image->output;
+      frame->pixels_size = image->output_size;
+      frame->indices = image->indices;
+      frame->palette = (CRGB*)(image->lct ? image->lct : ctx.gct);
+      frame->palette_size = image->lct ? image->lct_size : ctx.gct_size;
+      frame->mask = image->mask;
+      frame->runs = NULL;
+      frame->runs_size = 0;
+      frame->run_colors = NULL;
+      frame->run_indices = NULL;
+      frame->light_valid = false;
+    }
+
+    static bool next_gif_frame(void* /*user*/, pixelbox::anim::frame_s* frame) //frame source callback of the renderer
+    {
+      if(!gif_file) return false; //closed since
+
+      //a single image GIF doesn't need to be decoded again, it stays displayed (without looping no GIF is decoded again)
+      if(gif.parsed && (gif.pass_images == 1 || !gif_loop))
+      {
+        close_gif();
+        return false;
+      }
+
+      img_parse::image_s* image;
+      if(img_parse::parse_next_image(gif, &image) != img_parse::error_code_ok)
+      {
+        close_gif();
+        return false;
+      }
+
+      image_to_frame(gif, image, frame);
+      return true;
+    }
+
+    pixelbox::anim::frame_source_s gif_source = {next_gif_frame, NULL, NULL};
+
+    static bool decode_lazy_gif(File& file, const sink_s* sink)
+    {
+      //big GIFs are decoded during playback, the renderer asks for the frames one by one and only the actual one is kept in RAM
+      gif_file = file;
+      gif_loop = sink->loop;
+      if(img_parse::init(gif, read_file, seek_file, &gif_file) != img_parse::error_code_ok ||
+         img_parse::set_output(gif, (img_parse::color_s*)sink->frame, sink->width * sink->height, sink->frame_mask) != img_parse::error_code_ok ||
+         img_parse::parse_header(gif) != img_parse::error_code_ok ||
+         (gif.lsd.height != sink->height || gif.lsd.width != sink->width))
+      {
+        close_gif();
+        return false;
+      }
+
+      sink->show_source(&gif_source);
+      return true;
+    }
+
+    static bool decode_gif(const String& /*filename*/, File& file, const sink_s* sink)
+    {
+      if(file.size() >= LAZY_GIF_MIN_FILE_SIZE) return decode_lazy_gif(file, sink);
+
+      //small GIFs are decoded into an animation, frame by frame into one buffer (it reads the file through a small buffer instead of loading it into RAM)
+      //every decoded frame is handed to the delta encoder in place, so the decoded frames and the animation are never in RAM at the same time
+      img_parse::gif_parse_context_s ctx;
+      if(img_parse::init(ctx, read_file, seek_file, &file) != img_parse::error_code_ok ||
+         img_parse::set_output(ctx, (img_parse::color_s*)sink->frame, sink->width * sink->height, sink->frame_mask) != img_parse::error_code_ok ||
+         img_parse::parse_header(ctx) != img_parse::error_code_ok ||
+         (ctx.lsd.height != sink->height || ctx.lsd.width != sink->width))
+      {
+        img_parse::deinit(ctx);
+        file.close();
+        return false;
+      }
+
+      //the animation is built in one pass, its slab grows geometrically and the slack is dropped at the end
+      pixelbox::anim::animation_s animation = {};
+      pixelbox::anim::delta_encoder_s encoder;
+      pixelbox::anim::frame_s frame;
+      bool still = false;
+      bool ok = pixelbox::anim::delta_encoder_init(&encoder, sink->width, sink->height);
+      while(ok)
+      {
+        img_parse::image_s* decoded;
+        if(img_parse::parse_next_image(ctx, &decoded) != img_parse::error_code_ok)
+        {
+          ok = false;
+          break;
+        }
+        image_to_frame(ctx, decoded, &frame);
+
+        //if it's an image, simply draw it onto the canvas (it can be partial and transparent too)
+        if(ctx.parsed && ctx.pass_images == 1)
+        {
+          CRGB* canvas = sink->begin_image();
+          fill_solid(canvas, sink->width * sink->height, CRGB::Black);
+          pixelbox::anim::blit(&frame, canvas, sink->width, sink->height);
+          still = true;
+          break;
+        }
+
+        ok = pixelbox::anim::add_delta_frame(&animation, &encoder, &frame);
+        if(sink->yield) sink->yield(); //decoding proceeds frame by frame between renders
+        if(ctx.parsed) break; //the trailer follows, every image is in the animation
+      }
+
+      //the indexed frames' shared palette goes into the slab, then dealloc everything left from the parsing
+      if(ok && !still) ok = pixelbox::anim::delta_encoder_finish(&animation, &encoder);
+      pixelbox::anim::delta_encoder_deinit(&encoder);
+      img_parse::deinit(ctx);
+      file.close();
+
+      if(!ok)
+      {
+        pixelbox::anim::animation_init(&animation);
+        return false;
+      }
+      if(still) sink->show_image();
+      else
+      {
+        pixelbox::anim::animation_shrink(&animation);
+        sink->show_animation(&animation); //the renderer takes over the slab
+      }
+      return true;
+    }
+
+    decoder_s gif_decoder = {"gif", probe_gif, decode_gif, close_gif, NULL};
+    bool gif_registered = register_decoder(&gif_decoder);
+  }
+}
@@ -0,0 +1,395 @@
+#include "decoder.hpp"
+
+#include "color.hpp"
+
+namespace pixelbox
+{
+  namespace decoder
+  {
+    typedef struct native_writer_s   //state of transcoding into a native container, the sink callbacks have no user pointer
+    {
+      File* file;
+      uint32_t width;
+      uint32_t height;
+      CRGB* buffer;                    //block of the sink's frame, mask and canvas
+      CRGB* canvas;                    //still images are drawn here
+      pixelbox::anim::delta_encoder_s encoder;
+      pixelbox::anim::animation_s frame; //the last encoded frame, its slab is reused
+      native_frame_s* table;           //frame table, written after the frame data
+      uint32_t frames_size;
+      uint32_t frames_allocated;
+      uint32_t data_size;
+      uint32_t max_frame_size;
+      bool ok;
+    }native_writer_s;
+
+    native_writer_s writer;
+
+    static bool probe_native(const uint8_t* header, uint32_t len)
+    {
+      return len >= 4 && memcmp(header, NATIVE_MAGIC, 4) == 0;
+    }
+
+    static bool check_frame(const native_header_s& header, const native_frame_s& entry) //the frame data is in the data area, aligned for its runs, and its runs are inside the data
+    {
+      if(entry.offset < sizeof(native_header_s) || entry.offset - sizeof(native_header_s) + entry.size > header.data_size) return false;
+      if(entry.offset % 4 != 0) return false; //the runs are read in place, unaligned words fault on the ESP8266
+      if(entry.type == native_frame_pixels) return entry.size >= header.width * header.height * sizeof(CRGB);
+      if(entry.type == native_frame_indexed && !header.palette_size) return false;
+      if(entry.type != native_frame_delta && entry.type != native_frame_indexed) return false;
+      return entry.runs_size * sizeof(pixelbox::anim::delta_run_s) <= entry.size;
+    }
+
+    static bool check_palette(const native_header_s& header) //the shared palette is in the data area
+    {
+      if(!header.palette_size) return true;
+      return header.palette_size <= DELTA_PALETTE_SIZE && header.palette_offset >= sizeof(native_header_s) &&
+             header.palette_offset - sizeof(native_header_s) + header.palette_size * sizeof(CRGB) <= header.data_size;
+    }
+
+    static bool entry_to_frame(const native_header_s& header, const native_frame_s& entry, uint8_t* data, CRGB* palette, pixelbox::anim::frame_s* frame) //describe the frame data as an animation frame, false if its runs don't fit in it
+    {
+      memset(frame, 0, sizeof(pixelbox::anim::frame_s));
+      frame->delay_ms = entry.delay_ms;
+      frame->width = header.width;
+      frame->height = header.height;
+      frame->disposal = pixelbox::anim::disposal_keep;
+      memcpy(frame->light, entry.light, sizeof(frame->light));
+      frame->light_valid = true;
+      if(entry.type == native_frame_pixels)
+      {
+        frame->pixels = (CRGB*)data;
+        frame->pixels_size = header.width * header.height;
+        return true;
+      }
+
+      //the colors (or palette indices) of the runs must be inside the frame data too
+      frame->runs = (pixelbox::anim::delta_run_s*)data;
+      frame->runs_size = entry.runs_size;
+      uint32_t color_size = sizeof(CRGB);
+      if(entry.type == native_frame_indexed)
+      {
+        frame->run_indices = (uint8_t*)(frame->runs + entry.runs_size);
+        frame->palette = palette;
+        frame->palette_size = header.palette_size;
+        color_size = sizeof(uint8_t);
+      }
+      else frame->run_colors = (CRGB*)(frame->runs + entry.runs_size);
+      uint32_t colors_size = 0;
+      for(uint32_t r = 0; r < entry.runs_size; r++)
+        colors_size += frame->runs[r].length;
+      return entry.runs_size * sizeof(pixelbox::anim::delta_run_s) + colors_size * color_size <= entry.size;
+    }
+
+    typedef struct native_stream_s   //native container played from flash, only the shown and the next frame are in RAM
+    {
+      File file;
+      native_header_s header;
+      uint8_t* buffer;        //block of the two frame buffers (max_frame_size each) and the shared palette
+      uint8_t* front;         //data of the shown frame
+      uint8_t* back;          //data of the next frame, read ahead
+      CRGB* palette;          //shared palette of the indexed frames
+      native_frame_s back_entry;
+      bool back_valid;        //the next frame was read ahead
+      uint32_t frame_index;   //frame read ahead next
+      bool loop;              //see sink_s::loop
+    }native_stream_s;
+
+    native_stream_s stream;
+
+    static void close_stream()
+    {
+      if(stream.file) stream.file.close();
+      if(stream.buffer) free(stream.buffer);
+      stream = native_stream_s();
+    }
+
+    static void prefetch_stream_frame(void* /*user*/) //read the next frame during the shown one's delay
+    {
+      if(!stream.file || stream.back_valid) return;
+      if(stream.frame_index >= stream.header.frames_size)
+      {
+        if(!stream.loop) return; //the source ends
+        stream.frame_index = 0;  //the first frame is a keyframe
+      }
+
+      //the frame table is an offset index, any frame is two seeks away
+      native_frame_s& entry = stream.back_entry;
+      bool ok = stream.file.seek(stream.header.table_offset + stream.frame_index * sizeof(native_frame_s)) &&
+                stream.file.read((uint8_t*)&entry, sizeof(entry)) == sizeof(entry) &&
+                check_frame(stream.header, entry) && entry.size <= stream.header.max_frame_size &&
+                stream.file.seek(entry.offset) && (uint32_t)stream.file.read(stream.back, entry.size) == entry.size;
+      if(!ok)
+      {
+        close_stream();
+        return;
+      }
+      stream.back_valid = true;
+      stream.frame_index++;
+    }
+
+    static bool next_stream_frame(void* user, pixelbox::anim::frame_s* frame) //frame source callback of the renderer
+    {
+      //normally the frame was read ahead, the first one (or a missed prefetch) is read now
+      prefetch_stream_frame(user);
+      if(!stream.back_valid)
+      {
+        close_stream();
+        return false;
+      }
+
+      //the read ahead buffer is shown, the other one becomes free for the next read
+      uint8_t* front = stream.back;
+      stream.back = stream.front;
+      stream.front = front;
+      stream.back_valid = false;
+      if(!entry_to_frame(stream.header, stream.back_entry, stream.front, stream.palette, frame))
+      {
+        close_stream();
+        return false;
+      }
+      return true;
+    }
+
+    pixelbox::anim::frame_source_s native_source = {next_stream_frame, NULL, prefetch_stream_frame};
+
+    static bool decode_native(const String& /*filename*/, File& file, const sink_s* sink)
+    {
+      native_header_s header;
+      native_frame_s entry;
+      bool ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                header.width == sink->width && header.height == sink->height && header.frames_size > 0 &&
+                header.table_offset >= sizeof(header) + header.data_size && check_palette(header);
+
+      //a still image is read right into the canvas
+      if(ok && header.frames_size == 1)
+      {
+        ok = file.seek(header.table_offset) && file.read((uint8_t*)&entry, sizeof(entry)) == sizeof(entry) &&
+             entry.type == native_frame_pixels && check_frame(header, entry) && file.seek(entry.offset);
+        if(ok)
+        {
+          uint32_t size = header.width * header.height * sizeof(CRGB);
+          ok = (uint32_t)file.read((uint8_t*)sink->begin_image(), size) == size;
+        }
+        file.close();
+        if(ok) sink->show_image();
+        return ok;
+      }
+
+      //big animations are played from flash, RAM use depends on the biggest frame only
+      //the loaded slab would hold the frame array too, many small delta frames make that the bigger part
+      if(ok && (uint64_t)header.frames_size * sizeof(pixelbox::anim::frame_s) + header.data_size > NATIVE_MAX_LOAD_SIZE)
+      {
+        close_stream();
+        uint32_t palette_size = header.palette_size * sizeof(CRGB);
+        uint32_t frame_buffer_size = (header.max_frame_size + 3) & ~3u; //the second buffer is aligned for its runs too
+        stream.buffer = header.max_frame_size <= header.data_size ? (uint8_t*)malloc(2 * frame_buffer_size + palette_size) : NULL;
+        if(stream.buffer == NULL)
+        {
+          file.close();
+          return false;
+        }
+        stream.front = stream.buffer;
+        stream.back = stream.buffer + frame_buffer_size;
+
+        //the palette stays in RAM for the whole playback
+        stream.palette = (CRGB*)(stream.buffer + 2 * frame_buffer_size);
+        if(palette_size && !(file.seek(header.palette_offset) && (uint32_t)file.read((uint8_t*)stream.palette, palette_size) == palette_size))
+        {
+          close_stream();
+          file.close();
+          return false;
+        }
+        stream.file = file;
+        stream.header = header;
+        stream.loop = sink->loop;
+        sink->show_source(&native_source);
+        return true;
+      }
+      ok = ok && file.seek(sizeof(header));
+
+      //the frame data has the layout of an animation slab's data area, it's read in one go and the frames point into it
+      pixelbox::anim::animation_s animation = {};
+      ok = ok && pixelbox::anim::animation_reserve(&animation, header.frames_size, header.data_size) &&
+           (uint32_t)file.read(animation.data, header.data_size) == header.data_size && file.seek(header.table_offset);
+      if(ok) animation.data_size = header.data_size;
+      CRGB* palette = ok && header.palette_size ? (CRGB*)(animation.data + header.palette_offset - sizeof(header)) : NULL;
+      for(uint32_t i = 0; ok && i < header.frames_size; i++)
+      {
+        ok = file.read((uint8_t*)&entry, sizeof(entry)) == sizeof(entry) && check_frame(header, entry) &&
+             entry_to_frame(header, entry, animation.data + entry.offset - sizeof(header), palette, &animation.frames[animation.frames_size++]);
+      }
+      file.close();
+
+      if(!ok)
+      {
+        pixelbox::anim::animation_init(&animation);
+        return false;
+      }
+      sink->show_animation(&animation); //the renderer takes over the slab
+      return true;
+    }
+
+    decoder_s native_decoder = {"native", probe_native, decode_native, close_stream, NULL};
+    bool native_registered = register_decoder(&native_decoder);
+
+    static void write_frame(const native_frame_s& entry, const void* data) //append the frame data and its table entry
+    {
+      if(!writer.ok) return;
+      if(writer.frames_size >= NATIVE_MAX_FRAMES)
+      {
+        writer.ok = false;
+        return;
+      }
+      if(writer.frames_size == writer.frames_allocated)
+      {
+        uint32_t frames_allocated = writer.frames_allocated ? writer.frames_allocated * 2 : FRAME_ALLOCATION_SIZE;
+        native_frame_s* table = (native_frame_s*)realloc(writer.table, frames_allocated * sizeof(native_frame_s));
+        if(table == NULL)
+        {
+          writer.ok = false;
+          return;
+        }
+        writer.table = table;
+        writer.frames_allocated = frames_allocated;
+      }
+      if(entry.size && writer.file->write((const uint8_t*)data, entry.size) != entry.size)
+      {
+        writer.ok = false;
+        return;
+      }
+      writer.table[writer.frames_size++] = entry;
+      writer.data_size += entry.size;
+      if(entry.size > writer.max_frame_size) writer.max_frame_size = entry.size;
+    }
+
+    static void write_anim_frame(const pixelbox::anim::frame_s* frame) //delta encode a frame of any kind and append it
+    {
+      if(!writer.ok) return;
+      pixelbox::anim::animation_clear(&writer.frame);
+      writer.ok = pixelbox::anim::add_delta_frame(&writer.frame, &writer.encoder, frame);
+      if(!writer.ok) return;
+
+      //encoded blocks are 4 byte aligned, like in the slab
+      const pixelbox::anim::frame_s* encoded = &writer.frame.frames[0];
+      native_frame_s entry;
+      entry.offset = sizeof(native_header_s) + writer.data_size;
+      entry.size = writer.frame.data_size;
+      entry.delay_ms = encoded->delay_ms;
+      entry.runs_size = encoded->runs_size;
+      entry.type = encoded->run_indices ? native_frame_indexed : native_frame_delta;
+      entry.keyframe = writer.frames_size % DELTA_KEYFRAME_INTERVAL == 0;
+      memcpy(entry.light, encoded->light, sizeof(entry.light));
+      write_frame(entry, encoded->runs);
+    }
+
+    static CRGB* writer_begin_image()
+    {
+      return writer.canvas;
+    }
+
+    static void writer_show_image()
+    {
+      native_frame_s entry;
+      entry.offset = sizeof(native_header_s) + writer.data_size;
+      entry.size = (writer.width * writer.height * sizeof(CRGB) + 3) & ~3u; //the padding is written from the end of the buffer
+      entry.delay_ms = 0;
+      entry.runs_size = 0;
+      entry.type = native_frame_pixels;
+      entry.keyframe = 1;
+      pixelbox::color::light(writer.canvas, writer.width * writer.height, entry.light);
+      write_frame(entry, writer.canvas);
+    }
+
+    static void writer_show_animation(pixelbox::anim::animation_s* anim)
+    {
+      for(uint32_t i = 0; i < anim->frames_size; i++)
+        write_anim_frame(&anim->frames[i]);
+      pixelbox::anim::animation_init(anim); //the sink takes over the slab
+    }
+
+    static void writer_show_source(pixelbox::anim::frame_source_s* source)
+    {
+      //the sink doesn't loop, so the source ends after the last frame
+      pixelbox::anim::frame_s frame;
+      while(writer.ok && source->next_frame(source->user, &frame))
+        write_anim_frame(&frame);
+    }
+
+    bool transcode(const String& filename, File& file, File& native, uint32_t width, uint32_t height)
+    {
+      //decoders working during playback are single instance, the transcoding would take them over
+      stop();
+
+      writer = native_writer_s();
+      writer.file = &native;
+      writer.width = width;
+      writer.height = height;
+      writer.ok = true;
+
+      //frame, canvas (and padding for the aligned pixels frame) then the mask in one block
+      uint32_t size = width * height;
+      writer.buffer = (CRGB*)calloc(2 * size * sizeof(CRGB) + 4 + (size + 7) / 8, 1);
+      if(writer.buffer == NULL) return false;
+      writer.canvas = writer.buffer + size;
+      sink_s sink = {width, height, writer.buffer, (uint8_t*)(writer.canvas + size) + 4,
+                     writer_begin_image, writer_show_image, writer_show_animation, writer_show_source, false, NULL};
+
+      //the header is written again when the sizes are known
+      native_header_s header;
+      memset(&header, 0, sizeof(header));
+      bool ok = pixelbox::anim::delta_encoder_init(&writer.encoder, width, height) &&
+                native.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                decode(filename, file, &sink) && writer.ok && writer.frames_size > 0;
+      stop();
+
+      //a single frame animation is stored as a still image, the pixels are never bigger than the keyframe's runs they overwrite
+      if(ok && writer.frames_size == 1 && writer.table[0].type != native_frame_pixels)
+      {
+        memcpy(writer.canvas, writer.encoder.canvas, size * sizeof(CRGB));
+        writer.frames_size = 0;
+        writer.data_size = 0;
+        writer.max_frame_size = 0;
+        ok = native.seek(sizeof(header));
+        writer_show_image();
+        ok = ok && writer.ok;
+      }
+
+      //the shared palette of the indexed frames is the last block of the frame data
+      bool indexed = false;
+      for(uint32_t i = 0; i < writer.frames_size && !indexed; i++)
+        indexed = writer.table[i].type == native_frame_indexed;
+      uint32_t palette_offset = sizeof(header) + writer.data_size;
+      uint32_t palette_size = indexed ? (writer.encoder.palette_size * sizeof(CRGB) + 3) & ~3u : 0; //the padding is written from the unused palette entries
+      if(ok && palette_size)
+      {
+        ok = native.write((const uint8_t*)writer.encoder.palette, palette_size) == palette_size;
+        writer.data_size += palette_size;
+      }
+
+      //the frame table follows the frame data
+      if(ok)
+      {
+        memcpy(header.magic, NATIVE_MAGIC, 4);
+        header.width = width;
+        header.height = height;
+        header.frames_size = writer.frames_size;
+        header.data_size = writer.data_size;
+        header.table_offset = sizeof(header) + writer.data_size;
+        header.max_frame_size = writer.max_frame_size;
+        header.palette_offset = indexed ? palette_offset : 0;
+        header.palette_size = indexed ? writer.encoder.palette_size : 0;
+        uint32_t table_size = writer.frames_size * sizeof(native_frame_s);
+        ok = native.write((const uint8_t*)writer.table, table_size) == table_size &&
+             native.seek(0) && native.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+      }
+
+      if(writer.buffer) free(writer.buffer);
+      if(writer.table) free(writer.table);
+      pixelbox::anim::delta_encoder_deinit(&writer.encoder);
+      pixelbox::anim::animation_init(&writer.frame);
+      writer = native_writer_s();
+      return ok;
+    }
+  }
+}
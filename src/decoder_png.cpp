@@ -0,0 +1,126 @@
+#include "decoder.hpp"
+
+#include "web.hpp"
+#include "png_parse.hpp"
+
+namespace pixelbox
+{
+  namespace decoder
+  {
+    static bool probe_png(const uint8_t* header, uint32_t len)
+    {
+      static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
+      return len >= 8 && memcmp(header, signature, 8) == 0;
+    }
+
+    static uint32_t read_file(void* user, uint8_t* buffer, uint32_t len) //byte source of the PNG parser
+    {
+      return ((File*)user)->read(buffer, len);
+    }
+
+    static bool seek_file(void* user, uint32_t position) //skipping and rewinding the PNG parser's byte source
+    {
+      return ((File*)user)->seek(position);
+    }
+
+    static void fctl_to_frame(img_parse::png_parse_context_s& ctx, const sink_s* sink, pixelbox::anim::frame_s* frame) //describe the last decoded APNG frame as an animation frame
+    {
+      const img_parse::fctl_s& fctl = ctx.fctl;
+      frame->delay_ms = (uint32_t)fctl.delay_num * 1000 / (fctl.delay_den ? fctl.delay_den : 100);
+      frame->x = fctl.x_offset;
+      frame->y = fctl.y_offset;
+      frame->width = fctl.width;
+      frame->height = fctl.height;
+      switch (fctl.dispose_op)
+      {
+      case img_parse::dispose_op_background: frame->disposal = pixelbox::anim::disposal_background; break;
+      case img_parse::dispose_op_previous: frame->disposal = ctx.frame_index == 1 ? pixelbox::anim::disposal_background : pixelbox::anim::disposal_previous; break; //the first frame reverts to the cleared canvas
+      default: frame->disposal = pixelbox::anim::disposal_keep; break;
+      }
+      frame->pixels = sink->frame;
+      frame->pixels_size = fctl.width * fctl.height;
+      frame->indices = NULL;
+      frame->palette = NULL;
+      frame->palette_size = 0;
+      frame->mask = fctl.blend_op == img_parse::blend_op_over ? sink->frame_mask : NULL;
+      frame->runs = NULL;
+      frame->runs_size = 0;
+      frame->run_colors = NULL;
+      frame->run_indices = NULL;
+      frame->light_valid = false;
+    }
+
+    static bool apng_to_animation(img_parse::png_parse_context_s& ctx, const sink_s* sink, pixelbox::anim::animation_s* animation) //decode every APNG frame into the delta encoded animation
+    {
+      //the frames are decoded one by one into the sink's frame buffer and built into the animation in one pass
+      //the frame count is known from acTL, the frame data grows geometrically and the slack is dropped at the end
+      pixelbox::anim::delta_encoder_s encoder = {};
+      pixelbox::anim::frame_s frame;
+      bool ok = pixelbox::anim::animation_reserve(animation, ctx.num_frames, 0) &&
+                pixelbox::anim::delta_encoder_init(&encoder, sink->width, sink->height);
+      for(uint32_t i = 0; ok && i < ctx.num_frames; i++)
+      {
+        //semi-transparent pixels are blended against the canvas the frame is drawn over
+        const CRGB* backdrop = pixelbox::anim::begin_delta_frame(&encoder);
+        ok = img_parse::parse_next_frame(ctx, (uint8_t*)sink->frame, sink->width * sink->height * sizeof(CRGB), sink->frame_mask, (const uint8_t*)backdrop);
+        if(!ok) break;
+        fctl_to_frame(ctx, sink, &frame);
+        ok = pixelbox::anim::add_delta_frame(animation, &encoder, &frame);
+        if(sink->yield) sink->yield(); //decoding proceeds frame by frame between renders
+      }
+      ok = ok && pixelbox::anim::delta_encoder_finish(animation, &encoder); //the indexed frames' shared palette
+      pixelbox::anim::delta_encoder_deinit(&encoder);
+      if(ok) pixelbox::anim::animation_shrink(animation);
+      return ok;
+    }
+
+    static bool decode_png(const String& filename, File& file, const sink_s* sink)
+    {
+      //PNGs validated at upload don't need their CRCs checked again, unless the file changed since
+      pixelbox::web::image_meta_s meta;
+      uint32_t img_size = file.size();
+      bool validated = pixelbox::web::get_image_meta(filename, meta) && meta.validated && meta.size == img_size;
+
+      //the file is read through the parser's small read buffer instead of loading it into RAM, it's closed when the decoding is done
+      img_parse::png_parse_context_s ctx;
+      if(!img_parse::init(ctx, read_file, seek_file, &file, img_size))
+      {
+        file.close();
+        return false;
+      }
+
+      ctx.validated = validated;
+      img_parse::set_background(ctx, (PNG_BACKGROUND_COLOR >> 16) & 0xFF, (PNG_BACKGROUND_COLOR >> 8) & 0xFF, PNG_BACKGROUND_COLOR & 0xFF);
+
+      //check for error OR image with invalid size
+      bool ok = img_parse::parse_header(ctx) && ctx.hdr.width == sink->width && ctx.hdr.height == sink->height;
+
+      //APNGs are decoded into an animation like the small GIFs, single frame ones are displayed as an image
+      pixelbox::anim::animation_s animation = {};
+      bool animated = ok && ctx.animated && ctx.num_frames > 1;
+      if(animated) ok = apng_to_animation(ctx, sink, &animation);
+      else if(ok)
+      {
+        //the pixels are written right into the renderer's canvas
+        CRGB* canvas = sink->begin_image();
+        ok = img_parse::parse_rgb(ctx, (uint8_t*)canvas, sink->width * sink->height * sizeof(CRGB));
+      }
+
+      //dealloc everything left from the parsing
+      img_parse::deinit(ctx);
+      file.close();
+      if(!ok)
+      {
+        pixelbox::anim::animation_init(&animation);
+        return false;
+      }
+
+      if(animated) sink->show_animation(&animation); //the renderer takes over the slab
+      else sink->show_image();
+      return true;
+    }
+
+    decoder_s png_decoder = {"png", probe_png, decode_png, NULL, NULL};
+    bool png_registered = register_decoder(&png_decoder);
+  }
+}
@@ -7,88 +7,180 @@
 
 namespace img_parse
 {
+  uint32_t read_input(void* user, uint8_t* buffer, uint32_t len)
+  {
+    //source for contexts initialized with an input buffer
+    gif_parse_context_s* ctx = (gif_parse_context_s*)user;
+    uint32_t remaining = ctx->input_size - ctx->source.position;
+    if(len > remaining) len = remaining;
+    memcpy(buffer, ctx->input + ctx->source.position, len);
+    return len;
+  }
+
+  bool seek_input(void* user, uint32_t position)
+  {
+    gif_parse_context_s* ctx = (gif_parse_context_s*)user;
+    return position <= ctx->input_size;
+  }
+
+  error_code_e seek(gif_parse_context_s& ctx, uint32_t position)
+  {
+    if(!ctx.source.seek) return error_code_not_supported;
+    if(!ctx.source.seek(ctx.source.user, position)) return error_code_out_of_bounds;
+
+    //drop the buffered bytes
+    ctx.source.position = position;
+    ctx.source.buffer_size = 0;
+    ctx.source.buffer_offset = 0;
+    ctx.offset = position;
+    return error_code_ok;
+  }
+
+  error_code_e fill_buffer(gif_parse_context_s& ctx)
+  {
+    if(!ctx.source.read) return error_code_null_pt;
+    uint32_t read = ctx.source.read(ctx.source.user, ctx.source.buffer, GIF_READ_BUFFER_SIZE);
+    if(read == 0) return error_code_out_of_bounds; //end of the source
+    ctx.source.position += read;
+    ctx.source.buffer_size = read;
+    ctx.source.buffer_offset = 0;
+    return error_code_ok;
+  }
+
+  error_code_e read_u8(gif_parse_context_s& ctx, uint8_t& value)
+  {
+    if(ctx.source.buffer_offset == ctx.source.buffer_size)
+    {
+      error_code_e err = fill_buffer(ctx);
+      if(err != error_code_ok) return err;
+    }
+    value = ctx.source.buffer[ctx.source.buffer_offset++];
+    ctx.offset++;
+    return error_code_ok;
+  }
+
+  error_code_e peek_u8(gif_parse_context_s& ctx, uint8_t& value) //next byte without consuming it
+  {
+    if(ctx.source.buffer_offset == ctx.source.buffer_size)
+    {
+      error_code_e err = fill_buffer(ctx);
+      if(err != error_code_ok) return err;
+    }
+    value = ctx.source.buffer[ctx.source.buffer_offset];
+    return error_code_ok;
+  }
+
+  error_code_e read_bytes(gif_parse_context_s& ctx, void* dst, uint32_t len)
+  {
+    //dst can be NULL for skipping bytes
+    uint8_t* out = (uint8_t*)dst;
+    while(len)
+    {
+      if(ctx.source.buffer_offset == ctx.source.buffer_size)
+      {
+        error_code_e err = fill_buffer(ctx);
+        if(err != error_code_ok) return err;
+      }
+      uint32_t copy_size = ctx.source.buffer_size - ctx.source.buffer_offset;
+      if(copy_size > len) copy_size = len;
+      if(out)
+      {
+        memcpy(out, ctx.source.buffer + ctx.source.buffer_offset, copy_size);
+        out += copy_size;
+      }
+      ctx.source.buffer_offset += copy_size;
+      ctx.offset += copy_size;
+      len -= copy_size;
+    }
+    return error_code_ok;
+  }
+
+  error_code_e skip_sub_blocks(gif_parse_context_s& ctx)
+  {
+    //skips data sub-blocks until the block terminator (consumed too)
+    for(;;)
+    {
+      uint8_t sub_block_size;
+      error_code_e err = read_u8(ctx, sub_block_size);
+      if(err != error_code_ok) return err;
+      if(sub_block_size == 0x00) return error_code_ok;
+      err = read_bytes(ctx, NULL, sub_block_size);
+      if(err != error_code_ok) return err;
+    }
+  }
+
   error_code_e parse_gct(gif_parse_context_s& ctx)
   {
     if(ctx.parsed) return error_code_parsed;
     if(!ctx.lsd.fields.global_color_table_flag) return error_code_ok; //if there is no gct we are done
     if(ctx.offset != 6 + 7) return error_code_out_of_bounds; //should follow header and lsd
 
-    //calc the gct size and check the input size
+    //calc the gct size
     uint32_t gct_size = (0x01 << (ctx.lsd.fields.global_color_table_size + 1)) * 3;    
-    if(ctx.input_size < (6 + 7 + gct_size)) return error_code_inconsistence;
 
-    //allocate memory for gct and copy it
+    //allocate memory for gct and read it
     ctx.gct = (color_s*)calloc(gct_size, 1);
     if(ctx.gct == NULL) return error_code_null_pt;
     ctx.gct_size = gct_size / 3;
-    memcpy(ctx.gct, ctx.input + ctx.offset, gct_size);
-
-    ctx.offset += gct_size;
-    return error_code_ok;
+    return read_bytes(ctx, ctx.gct, gct_size);
   }
 
   error_code_e parse_lsd(gif_parse_context_s& ctx)
   {
     if(ctx.parsed) return error_code_parsed;
     if(ctx.offset != 6) return error_code_inconsistence; //should follow header
-    if(ctx.input_size < 6 + 6) return error_code_out_of_bounds;
 
-    memcpy(&ctx.lsd.width, ctx.input + ctx.offset, sizeof(ctx.lsd.width));
-    memcpy(&ctx.lsd.height, ctx.input + ctx.offset + 2, sizeof(ctx.lsd.height));
-    memcpy(&ctx.lsd.fields, ctx.input + ctx.offset + 4, sizeof(ctx.lsd.fields));
-    ctx.lsd.background_color_index = ctx.input[ctx.offset + 5];
-    ctx.lsd.pixel_aspect_ratio = ctx.input[ctx.offset + 6];
+    uint8_t lsd[7];
+    error_code_e err = read_bytes(ctx, lsd, sizeof(lsd));
+    if(err != error_code_ok) return err;
+
+    memcpy(&ctx.lsd.width, lsd, sizeof(ctx.lsd.width));
+    memcpy(&ctx.lsd.height, lsd + 2, sizeof(ctx.lsd.height));
+    memcpy(&ctx.lsd.fields, lsd + 4, sizeof(ctx.lsd.fields));
+    ctx.lsd.background_color_index = lsd[5];
+    ctx.lsd.pixel_aspect_ratio = lsd[6];
 
-    ctx.offset += 7;
     return error_code_ok;
   }
 
   error_code_e check_header(gif_parse_context_s& ctx)
   {
-    if(ctx.input_size < 6) return error_code_inconsistence;
     if(ctx.offset != 0) return error_code_inconsistence;
 
+    uint8_t header[6];
+    if(read_bytes(ctx, header, sizeof(header)) != error_code_ok) return error_code_inconsistence;
+
     //ASCII 'GIF'
-    if(ctx.input[0] != 0x47) return error_code_inconsistence;
-    if(ctx.input[1] != 0x49) return error_code_inconsistence;
-    if(ctx.input[2] != 0x46) return error_code_inconsistence;
+    if(header[0] != 0x47) return error_code_inconsistence;
+    if(header[1] != 0x49) return error_code_inconsistence;
+    if(header[2] != 0x46) return error_code_inconsistence;
 
     //version '89a' and '87a'
-    if(ctx.input[3] != 0x38) return error_code_inconsistence;
-    if(ctx.input[4] != 0x39 && ctx.input[4] != 0x37) return error_code_inconsistence;
-    if(ctx.input[5] != 0x61) return error_code_inconsistence;
+    if(header[3] != 0x38) return error_code_inconsistence;
+    if(header[4] != 0x39 && header[4] != 0x37) return error_code_inconsistence;
+    if(header[5] != 0x61) return error_code_inconsistence;
 
-    ctx.offset += 6;
     return error_code_ok;
   }
   
-  error_code_e add_code_table_entry(image_s* image, uint16_t code, void* string_pt, uint32_t string_size)
+  error_code_e add_code_table_entry(image_s* image, uint16_t prefix, uint8_t suffix)
   {
     if(!image) return error_code_null_pt;
-    if(image->code_size < 2) return error_code_inconsistence;
-    if(!image->code_table.entries) return error_code_null_pt;
-    if(code >= 0x01 << (image->code_size + 1)) return error_code_out_of_bounds; //over indexing
+    if(!image->code_table) return error_code_null_pt;
+    code_table_s* table = image->code_table;
+    if(prefix >= table->entries_count) return error_code_out_of_bounds; //over indexing
 
-    //alloc and copy
+    //the table is full, the encoder has to send a cc, until that the codes are used without adding new ones
+    if(table->entries_count == LZW_CODE_TABLE_SIZE) return error_code_ok;
 
-    //if the allocation would be too small for (32bit) allocate bigger space
-    uint32_t alloc_size = string_size;
-    if(alloc_size < 4) alloc_size = 4;
+    table->prefix[table->entries_count] = prefix;
+    table->suffix[table->entries_count] = suffix;
+    table->first[table->entries_count] = table->first[prefix];
+    table->entries_count++;
 
-    image->code_table.entries[code].string = (uint8_t*)calloc(0x01, alloc_size);
-    if(!image->code_table.entries[code].string) return error_code_mem_alloc;
-    memcpy(image->code_table.entries[code].string, string_pt, string_size);
-    image->code_table.entries_count++;
-    image->code_table.entries[code].string_size = string_size;
-
-    if(image->code_table.entries_count == (uint32_t)(0x01 << (image->code_size + 1))) //code size bump time baby
-    {
+    //code size bump time baby (max 12 bit)
+    if(table->entries_count == (uint32_t)(0x01 << (image->code_size + 1)) && image->code_size < 11)
       image->code_size++;
-      image->code_table.entries = (code_table_entry_s*)realloc(image->code_table.entries, sizeof(code_table_entry_s) * (0x01 << (image->code_size + 1)));
-      if(!image->code_table.entries) return error_code_mem_alloc;
-      //zero the newly allocated space
-      memset(image->code_table.entries + (0x1 << image->code_size), 0, sizeof(code_table_entry_s) * (0x1 << image->code_size));
-    }
 
     return error_code_ok;
   }
@@ -96,48 +188,22 @@ namespace img_parse
   error_code_e init_code_table(image_s* image)
   {
     if(!image) return error_code_null_pt;
-    if(image->code_size < 2) return error_code_inconsistence; //min allowed code size
-
-    //allocate mem for code table                     
-    image->code_table.entries = (code_table_entry_s*)calloc(0x01 << (image->code_size + 1), sizeof(code_table_entry_s));
-    image->code_table.entries_count = 0;
-    if(!image->code_table.entries) return error_code_mem_alloc;
-
-    //add trivial codes
-    for(uint16_t code = 0; code < (0x01 << image->code_size) + 2; code++)
-      add_code_table_entry(image, code, &code, 0x01); //+2 means it adds cc and eoi too
-
-    //control codes for convenience
-    image->code_table.cc =  (0x01 << image->code_size);
-    image->code_table.eoi = (0x01 << image->code_size) + 1;
-
-    return error_code_ok;
-  }
-
-  error_code_e deinit_code_table(image_s* image)
-  {
-    if(!image) return error_code_null_pt;
-
-    //free the mem of entries
-    for(uint16_t code = 0; code < image->code_table.entries_count; code++)
+    if(!image->code_table) return error_code_null_pt;
+    if(image->starting_code_size < 2 || image->starting_code_size > 11) return error_code_inconsistence; //allowed code sizes
+
+    //no allocation here, only resetting the table to the trivial codes
+    code_table_s* table = image->code_table;
+    image->code_size = image->starting_code_size;
+    table->cc = (0x01 << image->code_size);
+    table->eoi = (0x01 << image->code_size) + 1;
+    for(uint16_t code = 0; code < table->cc; code++)
     {
-      if(image->code_table.entries[code].string)
-      {
-        free(image->code_table.entries[code].string);
-        image->code_table.entries[code].string = NULL;
-        image->code_table.entries[code].string_size = 0;
-      }
+      table->prefix[code] = LZW_NO_PREFIX;
+      table->suffix[code] = (uint8_t)code;
+      table->first[code] = (uint8_t)code;
     }
+    table->entries_count = table->eoi + 1; //cc and eoi are in the table too, but they have no strings
 
-    //free the table
-    if(image->code_table.entries)
-    {
-      free(image->code_table.entries);
-      image->code_table.entries = NULL;
-      image->code_table.entries_count = 0;
-      image->code_table.cc = 0;
-      image->code_table.eoi = 0;
-    }
     return error_code_ok;
   }
 
@@ -150,99 +216,111 @@ namespace img_parse
     image_s* image_pt = ctx.images + (ctx.images_size - 1);
     if(!image_pt->id.fields.local_color_table_flag) return error_code_ok;
 
-    //calc the lct size and check the input size
+    //calc the lct size
     uint32_t lct_size = (0x01 << (image_pt->id.fields.local_color_table_size + 1)) * 3;
-    if(ctx.input_size < (ctx.offset + lct_size)) return error_code_out_of_bounds;
 
-    //allocate memory for lct and copy it
+    //allocate memory for lct and read it
     image_pt->lct = (color_s*)calloc(lct_size, 1);
     if(image_pt->lct == NULL) return error_code_mem_alloc;
     image_pt->lct_size = lct_size / 3;
-    memcpy(image_pt->lct, ctx.input + ctx.offset, lct_size);
-
-    ctx.offset += lct_size;
-    return error_code_ok;
+    return read_bytes(ctx, image_pt->lct, lct_size);
   }
 
   error_code_e parse_gce(gif_parse_context_s& ctx)
   {
+    //introducer and label are already consumed
     if(ctx.parsed) return error_code_parsed;
-    if(ctx.input_size < (ctx.offset + 8)) return error_code_out_of_bounds;
-    if(*(ctx.input + ctx.offset) != block_type_extension_introducer) return error_code_inconsistence;
-    if(*(ctx.input + ctx.offset + 1) != block_label_graphic_control) return error_code_inconsistence;
+
+    uint8_t gce[6];
+    error_code_e err = read_bytes(ctx, gce, sizeof(gce));
+    if(err != error_code_ok) return err;
 
     //checks of fixed length block
-    if(*(ctx.input + ctx.offset + 2) != 4) return error_code_inconsistence; //sub block data length
-    if(*(ctx.input + ctx.offset + 7) != 0) return error_code_inconsistence; //block terminator
+    if(gce[0] != 4) return error_code_inconsistence; //sub block data length
+    if(gce[5] != 0) return error_code_inconsistence; //block terminator
 
-    memcpy(&ctx.last_gce.fields, ctx.input + ctx.offset + 3, 1);
-    memcpy(&ctx.last_gce.delay_time_10ms, ctx.input + ctx.offset + 4, 2);
-    memcpy(&ctx.last_gce.transparent_color_index, ctx.input + ctx.offset + 6, 1);
+    memcpy(&ctx.last_gce.fields, gce + 1, 1);
+    memcpy(&ctx.last_gce.delay_time_10ms, gce + 2, 2);
+    memcpy(&ctx.last_gce.transparent_color_index, gce + 4, 1);
     ctx.last_gce.valid = true;
 
-    ctx.offset += 8;
     return error_code_ok;
   }
 
-  error_code_e read_code(image_s* image)
+  error_code_e read_code(gif_parse_context_s& ctx, image_s* image)
   {
     if(image == NULL) return error_code_null_pt;
-    if(image->lzw_offset_byte >= image->lzw_size) return error_code_out_of_bounds;
 
     //save the last code
     image->last_code = image->code;
 
-    image->code = 0;
-    //over reading protection for valgrind
-    uint32_t read_size = (image->lzw_size - image->lzw_offset_byte) > 4 ? 4 : image->lzw_size - image->lzw_offset_byte;    
-
-    //read two bytes
-    memcpy(&(image->code), image->lzw + image->lzw_offset_byte, read_size);
-
-    //remove the unnecessary bits before the code
-    image->code = image->code >> image->lzw_offset_bit; 
-
-    //maks the unnecessary bits after the code
-    uint16_t mask = 0;
-    for(uint16_t i = 0; i < (image->code_size + 1); i++)
-      mask |= 0x01 << i;
-    image->code &= mask;
-
-    //adjust the offsets
-    image->lzw_offset_bit += image->code_size + 1;
-    if(image->lzw_offset_bit >= 8)
+    //feed the bit reader byte by byte, stepping over the sub-block boundaries
+    uint8_t code_bits = image->code_size + 1;
+    while(image->lzw_bits_count < code_bits)
     {
-      image->lzw_offset_byte += image->lzw_offset_bit / 8;
-      image->lzw_offset_bit = image->lzw_offset_bit % 8;
+      error_code_e err;
+      if(image->lzw_sub_block_left == 0)
+      {
+        err = read_u8(ctx, image->lzw_sub_block_left);
+        if(err != error_code_ok) return err;
+        if(image->lzw_sub_block_left == 0) return error_code_out_of_bounds; //block terminator before eoi
+      }
+
+      uint8_t byte;
+      err = read_u8(ctx, byte);
+      if(err != error_code_ok) return err;
+      image->lzw_sub_block_left--;
+      image->lzw_bits |= (uint32_t)byte << image->lzw_bits_count;
+      image->lzw_bits_count += 8;
     }
 
+    //take the code from the lowest bits
+    image->code = image->lzw_bits & ((0x01 << code_bits) - 1);
+    image->lzw_bits >>= code_bits;
+    image->lzw_bits_count -= code_bits;
+
     return error_code_ok;
   }
 
   bool is_in_code_table(image_s* image, uint16_t code)
   {
-    if(code > (0x01 << (image->code_size + 1))) return false;
-    return image->code_table.entries[code].string_size != 0 ? true : false;
+    if(code == image->code_table->cc || code == image->code_table->eoi) return false;
+    return code < image->code_table->entries_count;
   }
 
-  error_code_e output_index(image_s* image, bool first_only = false, bool last = false)
+  error_code_e output_index(image_s* image, uint16_t code)
   {
     if(!image) return error_code_null_pt;
-    uint32_t code = last ? image->last_code : image->code;
     if(!is_in_code_table(image, code)) return error_code_inconsistence;
-    uint32_t copy_size = first_only ? 1 : image->code_table.entries[code].string_size;
+    code_table_s* table = image->code_table;
+
+    //walk the prefix chain once to get the string size
+    uint32_t string_size = 0;
+    for(uint16_t c = code; c != LZW_NO_PREFIX; c = table->prefix[c]) string_size++;
 
-    //realloc if necessary
-    if(image->index_stream_offset + copy_size > image->index_stream_size)
+    //the chain gives the string backwards, so fill it from its end
+    //pixels over the image size are dropped
+    uint32_t end = image->output_offset + string_size;
+    uint32_t pixel = end;
+    for(uint16_t c = code; c != LZW_NO_PREFIX; c = table->prefix[c])
     {
-      image->index_stream = (uint8_t*)realloc(image->index_stream, image->index_stream_size + INDEX_STREAM_ALLOCATION_BLOCK);
-      if(!image->index_stream) return error_code_mem_alloc;
-      image->index_stream_size = image->index_stream_size + INDEX_STREAM_ALLOCATION_BLOCK;
-    }
+      pixel--;
+      if(pixel >= image->output_size) continue;
+      uint8_t index = table->suffix[c];
 
-    //append string to the index stream
-    memcpy(image->index_stream + image->index_stream_offset, image->code_table.entries[code].string, copy_size);
-    image->index_stream_offset += copy_size;
+      //transparent pixels are marked in the mask, their color is black but not used
+      if(image->transparency && index == image->gce.transparent_color_index)
+      {
+        image->mask[pixel / 8] |= 0x01 << (pixel % 8);
+        if(image->indices) image->indices[pixel] = index;
+        else image->output[pixel] = color_s{0, 0, 0};
+        continue;
+      }
+      if(index >= image->color_table_size) return error_code_out_of_bounds; //protection against over indexing color_table
+      if(image->indices) image->indices[pixel] = index;
+      else image->output[pixel] = image->color_table[index];
+    }
+    image->output_offset = end;
 
     return error_code_ok;
   }
@@ -251,34 +329,20 @@ namespace img_parse
   {
     if(!image) return error_code_null_pt;
 
-    //free local color table
-    if(image->lct)
+    //free local color table (indexed images keep it for the indices)
+    if(image->lct && !image->indices)
     {
       free(image->lct);
       image->lct = NULL;
       image->lct_size = 0;
     }
 
-    //free LZW compressed data
-    if(image->lzw)
-    {
-      free(image->lzw);
-      image->lzw = NULL;
-      image->lzw_size = 0;
-      image->lzw_offset_bit = 0;
-      image->lzw_offset_byte = 0;
-    }
-
-    //free the entire code table
-    deinit_code_table(image);
+    //the code table is owned by the context
+    image->code_table = NULL;
 
-    if(image->index_stream)
-    {
-      free(image->index_stream);
-      image->index_stream = NULL;
-      image->index_stream_offset = 0,
-      image->index_stream_size = 0;
-    }
+    //the color table is either the lct or the context's gct
+    image->color_table = NULL;
+    image->color_table_size = 0;
 
     return error_code_ok;
   }
@@ -288,24 +352,53 @@ namespace img_parse
     if(!image) return error_code_null_pt;
 
     free_image_parsing_memory(image);
+    if(image->lct)
+    {
+      free(image->lct);
+      image->lct = NULL;
+      image->lct_size = 0;
+    }
+    if(image->indices)
+    {
+      free(image->indices);
+      image->indices = NULL;
+    }
+    if(image->output_borrowed)
+    {
+      image->output = NULL;
+      image->mask = NULL;
+    }
     if(image->output)
     {
       free(image->output);
       image->output = NULL;
       image->output_size = 0;
     }
+    if(image->mask)
+    {
+      free(image->mask);
+      image->mask = NULL;
+    }
 
     return error_code_ok;
   }
 
   error_code_e parse_image(gif_parse_context_s& ctx)
   {    
+    //image separator is already consumed
     if(ctx.parsed) return error_code_parsed;
-    if(*(ctx.input + ctx.offset) != block_type_image_descriptor) return error_code_inconsistence;
-    if(ctx.input_size - ctx.offset < 10) return error_code_inconsistence; //at least the idesc
+
+    uint8_t id[9];
+    error_code_e err = read_bytes(ctx, id, sizeof(id));
+    if(err != error_code_ok) return err;
 
     //allocate mem for the new image data
-    if(ctx.images == NULL)
+    if(ctx.lazy && ctx.images != NULL) //frame by frame decoding reuses the only image struct
+    {
+      deinit_image(ctx.images);
+      memset(ctx.images, 0, sizeof(image_s));
+    }
+    else if(ctx.images == NULL)
     {
       ctx.images = (image_s*)calloc(1, sizeof(image_s));
       if(ctx.images == NULL) return error_code_mem_alloc;
@@ -323,16 +416,19 @@ namespace img_parse
     image_s* image_pt = ctx.images + (ctx.images_size - 1);
 
     //parse image descriptor of the image
-    memcpy(&image_pt->id.left_position, ctx.input + ctx.offset + 1, 2);
-    memcpy(&image_pt->id.top_position, ctx.input + ctx.offset + 1 + 2, 2);
-    memcpy(&image_pt->id.width, ctx.input + ctx.offset + 1 + 4, 2);
-    memcpy(&image_pt->id.height, ctx.input + ctx.offset + 1 + 6, 2);
-    memcpy(&image_pt->id.fields, ctx.input + ctx.offset + 1 + 8, 1);
+    memcpy(&image_pt->id.left_position, id, 2);
+    memcpy(&image_pt->id.top_position, id + 2, 2);
+    memcpy(&image_pt->id.width, id + 4, 2);
+    memcpy(&image_pt->id.height, id + 6, 2);
+    memcpy(&image_pt->id.fields, id + 8, 1);
 
     //don't supported functions
     if(image_pt->id.fields.interlace_flag) return error_code_not_supported;
-    if(image_pt->id.height != ctx.lsd.height) return error_code_not_supported;
-    if(image_pt->id.width != ctx.lsd.width) return error_code_not_supported;
+
+    //partial images have to fit into the logical screen
+    if(image_pt->id.width == 0 || image_pt->id.height == 0) return error_code_inconsistence;
+    if((uint32_t)image_pt->id.left_position + image_pt->id.width > ctx.lsd.width) return error_code_out_of_bounds;
+    if((uint32_t)image_pt->id.top_position + image_pt->id.height > ctx.lsd.height) return error_code_out_of_bounds;
 
     if(ctx.last_gce.valid)
     {
@@ -341,149 +437,156 @@ namespace img_parse
     }
 
     //parse local color table
-    ctx.offset += 1 + 9;
-    error_code_e err = parse_lct(ctx);
+    err = parse_lct(ctx);
     if(err != error_code_ok) return err;
 
     //minimum code size in bits
-    image_pt->code_size = *(ctx.input + ctx.offset); 
+    err = read_u8(ctx, image_pt->code_size);
+    if(err != error_code_ok) return err;
     if(image_pt->code_size < 2) return error_code_inconsistence; //min allowed code size
     image_pt->starting_code_size = image_pt->code_size;
 
-    //read and concatenate data sub-blocks into lzw buffer
-    uint32_t offset = ctx.offset + 1;
-    while(*(ctx.input + offset) != 0x00) //block terminator
+    //the output stage looks up the colors right away
+    image_pt->color_table = image_pt->id.fields.local_color_table_flag ? image_pt->lct : ctx.gct;
+    image_pt->color_table_size = image_pt->id.fields.local_color_table_flag ? image_pt->lct_size : ctx.gct_size;
+    image_pt->transparency = image_pt->gce.valid && image_pt->gce.fields.transparent_color_flag;
+
+    //destination of the pixels, sized from the image descriptor
+    image_pt->output_size = image_pt->id.width * image_pt->id.height;
+    if(ctx.indexed_output)
+    {
+      image_pt->indices = (uint8_t*)malloc(image_pt->output_size);
+      if(!image_pt->indices) return error_code_mem_alloc;
+      if(image_pt->transparency)
+      {
+        image_pt->mask = (uint8_t*)malloc((image_pt->output_size + 7) / 8);
+        if(!image_pt->mask) return error_code_mem_alloc;
+      }
+    }
+    else if(ctx.output)
+    {
+      if(image_pt->output_size > ctx.output_size) return error_code_out_of_bounds;
+      image_pt->output = ctx.output;
+      image_pt->mask = image_pt->transparency ? ctx.output_mask : NULL;
+      image_pt->output_borrowed = true;
+      if(image_pt->transparency && !image_pt->mask) return error_code_null_pt;
+    }
+    else
     {
-      uint8_t sub_block_size = *(ctx.input + offset);
-      if((ctx.input_size - offset) < ((uint32_t)sub_block_size + 1)) return error_code_out_of_bounds;      
-      image_pt->lzw = (uint8_t*)realloc(image_pt->lzw, image_pt->lzw_size + sub_block_size);
-      if(image_pt->lzw == NULL) return error_code_mem_alloc;
-      memcpy(image_pt->lzw + image_pt->lzw_size, ctx.input + offset + 1, sub_block_size);
-      image_pt->lzw_size += sub_block_size;
-      image_pt->lzw_offset_byte = 0;
-      image_pt->lzw_offset_bit = 0;
-      offset += sub_block_size + 1;
+      image_pt->output = (color_s*)malloc(image_pt->output_size * sizeof(color_s));
+      if(!image_pt->output) return error_code_mem_alloc;
+      if(image_pt->transparency)
+      {
+        image_pt->mask = (uint8_t*)malloc((image_pt->output_size + 7) / 8);
+        if(!image_pt->mask) return error_code_mem_alloc;
+      }
     }
-    ctx.offset = offset + 1;
+    if(image_pt->mask) memset(image_pt->mask, 0, (image_pt->output_size + 7) / 8);
 
     //parse lzw: http://giflib.sourceforge.net/whatsinagif/lzw_image_data.html
-    
+
+    //the dictionary is allocated for the first image only
+    if(!ctx.code_table)
+    {
+      ctx.code_table = (code_table_s*)malloc(sizeof(code_table_s));
+      if(!ctx.code_table) return error_code_mem_alloc;
+    }
+    image_pt->code_table = ctx.code_table;
+
     err = init_code_table(image_pt);
     if(err != error_code_ok) return err;
 
     //first code should be cc
-    err = read_code(image_pt);
+    err = read_code(ctx, image_pt);
     if(err != error_code_ok) return err;
-    if(image_pt->code != image_pt->code_table.cc) return error_code_inconsistence;
+    if(image_pt->code != image_pt->code_table->cc) return error_code_inconsistence;
 
-    //second code should be in the table, output it right away
-    err = read_code(image_pt);
-    if(err != error_code_ok) return err;
-    err = output_index(image_pt);
-    if(err != error_code_ok) return err;
-
-    for(uint32_t i = 0;; i++)
+    for(;;)
     {
-      err = read_code(image_pt); //over inedxing protection included
+      err = read_code(ctx, image_pt); //over inedxing protection included
       if(err != error_code_ok) return err;
-      if(image_pt->code == image_pt->code_table.cc)
+      if(image_pt->code == image_pt->code_table->cc)
       {
-        image_pt->code_size = image_pt->starting_code_size;
-        deinit_code_table(image_pt);
         init_code_table(image_pt);
-        break;
+        continue;
       }
-      if(image_pt->code == image_pt->code_table.eoi) break; //successfully parsed the entire lzw data array
-      if(is_in_code_table(image_pt, image_pt->code))
+      if(image_pt->code == image_pt->code_table->eoi) break; //successfully parsed the entire lzw data array
+      if(image_pt->last_code == image_pt->code_table->cc) //first code after a cc is a trivial one, output it right away
       {
-        err = output_index(image_pt);
-        if(err != error_code_ok) return err;
-        uint8_t c = *(image_pt->code_table.entries[image_pt->code].string); //first index of the current code
-        //overcopy for fewer allocation
-        err = add_code_table_entry(image_pt, image_pt->code_table.entries_count, image_pt->code_table.entries[image_pt->last_code].string, image_pt->code_table.entries[image_pt->last_code].string_size + 1); 
+        err = output_index(image_pt, image_pt->code);
         if(err != error_code_ok) return err;
-        image_pt->code_table.entries[image_pt->code_table.entries_count - 1].string[image_pt->code_table.entries[image_pt->code_table.entries_count - 1].string_size - 1] = c;
       }
-      else
+      else if(is_in_code_table(image_pt, image_pt->code))
       {
-        err = output_index(image_pt, false, true); //all indexes of the last code
+        err = output_index(image_pt, image_pt->code);
         if(err != error_code_ok) return err;
-        err = output_index(image_pt, true, true); //first index of the last code
+        //new string: last code's string + first index of the current code
+        err = add_code_table_entry(image_pt, image_pt->last_code, image_pt->code_table->first[image_pt->code]);
+        if(err != error_code_ok) return err;
+      }
+      else if(image_pt->code == image_pt->code_table->entries_count)
+      {
+        //new string: last code's string + first index of the last code, it's the current code too
+        err = add_code_table_entry(image_pt, image_pt->last_code, image_pt->code_table->first[image_pt->last_code]);
         if(err != error_code_ok) return err;
-        uint32_t last_string_size = image_pt->code_table.entries[image_pt->last_code].string_size;
-        err = add_code_table_entry(image_pt, image_pt->code, image_pt->index_stream + image_pt->index_stream_offset - last_string_size - 1, last_string_size + 1);
+        err = output_index(image_pt, image_pt->code);
         if(err != error_code_ok) return err;
       }
+      else return error_code_inconsistence;
     }
 
-    deinit_code_table(image_pt);
-    if(image_pt->lzw)
-    {
-      free(image_pt->lzw);
-      image_pt->lzw = NULL;
-      image_pt->lzw_size = 0;
-      image_pt->lzw_offset_bit = 0;
-      image_pt->lzw_offset_byte = 0;
-    }
+    image_pt->code_table = NULL;
+
+    //skip the padding after eoi until the block terminator
+    err = read_bytes(ctx, NULL, image_pt->lzw_sub_block_left);
+    if(err != error_code_ok) return err;
+    image_pt->lzw_sub_block_left = 0;
+    err = skip_sub_blocks(ctx);
+    if(err != error_code_ok) return err;
 
     //just some extra checking
-    if(image_pt->index_stream_offset != (image_pt->id.height * image_pt->id.width))
+    if(image_pt->output_offset < image_pt->output_size)
       return error_code_inconsistence;
 
-    //create RGBA array based on index stream and color tables
-    color_s* color_table = image_pt->id.fields.local_color_table_flag ? image_pt->lct : ctx.gct;
-    uint32_t color_table_size = image_pt->id.fields.local_color_table_flag ? image_pt->lct_size : ctx.gct_size;
-    image_pt->output = (color_s*)calloc(image_pt->index_stream_offset, sizeof(color_s));
-    if(!image_pt->output) return error_code_mem_alloc;
-    image_pt->output_size = image_pt->index_stream_offset;
-    for(uint32_t i = 0; i < image_pt->index_stream_offset; i++)
-    {
-      if(image_pt->index_stream[i] > color_table_size) return error_code_out_of_bounds; //protection against over indexing color_table
-      memcpy(&image_pt->output[i], &color_table[image_pt->index_stream[i]], sizeof(color_s));
-    }
-
     return error_code_ok;
   }
 
   error_code_e parse_extension(gif_parse_context_s& ctx)
   {
+    //extension introducer is already consumed
     if(ctx.parsed) return error_code_parsed;
-    if(ctx.input_size < ctx.offset + 4) return error_code_out_of_bounds;
-    if(*(ctx.input + ctx.offset) != block_type_extension_introducer) return error_code_inconsistence;
+
+    uint8_t label;
+    error_code_e err = read_u8(ctx, label);
+    if(err != error_code_ok) return err;
 
     //supported extensions
-    if(*(ctx.input + ctx.offset + 1) == block_label_graphic_control) return parse_gce(ctx);
+    if(label == block_label_graphic_control) return parse_gce(ctx);
 
     //skipping all the blocks of the extension
-    uint8_t block_size = *(ctx.input + ctx.offset + 2);
-    if((ctx.input_size - ctx.offset) < (uint32_t)(3 + block_size)) return error_code_out_of_bounds;
-
-    uint32_t offset = ctx.offset + 3 + block_size;    
-    while(*(ctx.input + offset) != 0x00) //block terminator
-    {
-      if((ctx.input_size - offset) < *(ctx.input + offset)) return error_code_out_of_bounds;
-      offset += *(ctx.input + offset) + 1;
-    }
-
-    ctx.offset = offset + 1;
-    return error_code_ok;
+    return skip_sub_blocks(ctx);
   }
 
   error_code_e parse_next_block(gif_parse_context_s& ctx)
   {
     if(ctx.parsed) return error_code_parsed;
 
-    uint8_t block_label = *(ctx.input + ctx.offset);
+    //some encoders omit the trailer, treat the end of input as one
+    uint8_t block_label;
+    if(read_u8(ctx, block_label) != error_code_ok)
+    {
+      ctx.parsed = true;
+      return error_code_ok;
+    }
 
     switch (block_label)
     {
     case block_type_image_descriptor:
     {
-      uint32_t images_size = ctx.images_size;
       error_code_e err =parse_image(ctx);
       if(err != error_code_ok) return err;
-      if(ctx.images_size == images_size + 1) //if there is a new images after parse, clean up the last parsed one
-        free_image_parsing_memory(&ctx.images[images_size]);
+      free_image_parsing_memory(&ctx.images[ctx.images_size - 1]); //clean up the last parsed one
+      ctx.pass_images++;
       break;
     }
     case block_type_trailer:
@@ -494,27 +597,77 @@ namespace img_parse
     case block_type_extension_introducer:
     {
       //skips all extension blocks except gce
-      parse_extension(ctx);
+      error_code_e err = parse_extension(ctx);
+      if(err != error_code_ok) return err;
       break;
     }
     default:
-      //handle unhandled blocks :)
-      break;
+      //unknown block, we can't find the next one
+      return error_code_inconsistence;
     }
 
     return error_code_ok;
   }
 
-  error_code_e init(gif_parse_context_s& ctx, uint8_t* input, uint32_t input_size)
+  void release_input(gif_parse_context_s& ctx)
   {
+    //only owned input is freed, borrowed input is just forgotten
+    if(ctx.input && ctx.input_owned) free((void*)ctx.input);
+    ctx.input = NULL;
+    ctx.input_size = 0;
+    ctx.input_owned = false;
+  }
+
+  error_code_e init(gif_parse_context_s& ctx, const uint8_t* input, uint32_t input_size)
+  {
+    if(input == NULL) return error_code_null_pt;
+
+    //dynamically allocate mem for input and store the input data
+    uint8_t* copy = (uint8_t*)calloc(input_size, 1);
+    if(copy == NULL) return error_code_mem_alloc;
+    memcpy(copy, input, input_size);
+
+    return init_owned(ctx, copy, input_size);
+  }
+
+  error_code_e init_borrowed(gif_parse_context_s& ctx, const uint8_t* input, uint32_t input_size)
+  {
+    if(input == NULL) return error_code_null_pt;
+
     //init the context struct
     memset(&ctx, 0, sizeof(ctx));
 
-    //dynamically allocate mem for input and store the input data
-    ctx.input = (uint8_t*)calloc(input_size, 1);
-    if(ctx.input == NULL) return error_code_mem_alloc;
+    //the input is only read, no need for a copy
+    ctx.input = input;
     ctx.input_size = input_size;
-    memcpy(ctx.input, input, ctx.input_size);
+    ctx.input_owned = false;
+
+    //the input buffer is read through the same source interface as streams
+    ctx.source.read = read_input;
+    ctx.source.seek = seek_input;
+    ctx.source.user = &ctx;
+
+    return error_code_ok;
+  }
+
+  error_code_e init_owned(gif_parse_context_s& ctx, uint8_t* input, uint32_t input_size)
+  {
+    error_code_e err = init_borrowed(ctx, input, input_size);
+    if(err != error_code_ok) return err;
+    ctx.input_owned = true;
+    return error_code_ok;
+  }
+
+  error_code_e init(gif_parse_context_s& ctx, read_cb read, seek_cb seek, void* user)
+  {
+    if(read == NULL) return error_code_null_pt;
+
+    //init the context struct
+    memset(&ctx, 0, sizeof(ctx));
+
+    ctx.source.read = read;
+    ctx.source.seek = seek;
+    ctx.source.user = user;
 
     return error_code_ok;
   }
@@ -536,17 +689,86 @@ namespace img_parse
       if(err != error_code_ok) return err;
     }
 
-    free(ctx.input);
-    ctx.input = NULL;
-    ctx.input_size = 0;
+    release_input(ctx);
+    return error_code_ok;
+  }
+
+  error_code_e parse_header(gif_parse_context_s& ctx)
+  {
+    if(ctx.parsed) return error_code_parsed;
+    if(!ctx.source.seek) return error_code_not_supported; //can't loop without seeking
+    error_code_e err;
+    err = check_header(ctx);
+    if(err != error_code_ok) return err;
+    err = parse_lsd(ctx);
+    if(err != error_code_ok) return err;
+    err = parse_gct(ctx);
+    if(err != error_code_ok) return err;
+
+    ctx.lazy = true;
+    ctx.first_block_offset = ctx.offset;
+    return error_code_ok;
+  }
+
+  error_code_e parse_next_image(gif_parse_context_s& ctx, image_s** image)
+  {
+    if(!ctx.lazy) return error_code_inconsistence; //parse_header first
+    if(image == NULL) return error_code_null_pt;
+
+    uint32_t pass_images = ctx.pass_images;
+    while(ctx.pass_images == pass_images)
+    {
+      if(ctx.parsed)
+      {
+        //reached the trailer, restart from the first block
+        if(ctx.pass_images == 0) return error_code_inconsistence; //there are no images at all
+        error_code_e err = seek(ctx, ctx.first_block_offset);
+        if(err != error_code_ok) return err;
+        ctx.parsed = false;
+        ctx.last_gce.valid = false;
+        ctx.loop_images = ctx.pass_images;
+        ctx.loop_count++;
+        ctx.pass_images = 0;
+        pass_images = 0;
+      }
+
+      error_code_e err = parse_next_block(ctx);
+      if(err != error_code_ok) return err;
+    }
+
+    //the blocks up to the next image are parsed ahead, so the end of the pass is known without decoding the first image again
+    uint8_t block_label;
+    while(!ctx.parsed && (peek_u8(ctx, block_label) != error_code_ok || block_label != block_type_image_descriptor))
+    {
+      error_code_e err = parse_next_block(ctx);
+      if(err != error_code_ok) return err;
+    }
+
+    *image = ctx.images;
+    return error_code_ok;
+  }
+
+  error_code_e set_output(gif_parse_context_s& ctx, color_s* output, uint32_t output_size, uint8_t* mask)
+  {
+    if(output == NULL) return error_code_null_pt;
+    ctx.output = output;
+    ctx.output_size = output_size;
+    ctx.output_mask = mask;
+    return error_code_ok;
+  }
+
+  error_code_e set_indexed_output(gif_parse_context_s& ctx)
+  {
+    ctx.indexed_output = true;
     return error_code_ok;
   }
 
   void deinit(gif_parse_context_s& ctx)
   {
     //deallocate all dynamically allocated memory and zero the entire struct
-    if(ctx.input) free(ctx.input);
+    release_input(ctx);
     if(ctx.gct) free(ctx.gct);
+    if(ctx.code_table) free(ctx.code_table);
     if(ctx.images)
     {
       for(uint32_t i = 0; i < ctx.images_size; i++) deinit_image(&ctx.images[i]);
@@ -0,0 +1,179 @@
+#include "image_cache.hpp"
+
+#include <Arduino.h>
+
+namespace pixelbox
+{
+  namespace image_cache
+  {
+    cache_entry_s entries[IMAGE_CACHE_ENTRIES];
+    uint32_t cached_size = 0;  //bytes held by all entries
+    uint32_t use_counter = 0;  //source of the LRU order
+
+    //state of the recording sink
+    decoder::sink_s recorder;
+    const decoder::sink_s* target = NULL;  //sink the recorder forwards to
+    char recorded_filename[IMAGE_CACHE_NAME_SIZE];
+    uint32_t recorded_version = 0;
+    CRGB* recorded_canvas = NULL;
+
+    static void evict(cache_entry_s* entry)
+    {
+      if(entry->image) free(entry->image);
+      anim::animation_init(&entry->animation);
+      cached_size -= entry->size;
+      memset(entry, 0, sizeof(cache_entry_s));
+    }
+
+    static cache_entry_s* find(const char* filename, uint32_t version)
+    {
+      for(uint32_t i = 0; i < IMAGE_CACHE_ENTRIES; i++)
+        if(entries[i].filename[0] && entries[i].version == version && strcmp(entries[i].filename, filename) == 0) return &entries[i];
+      return NULL;
+    }
+
+    static cache_entry_s* least_recently_used(const cache_entry_s* except)
+    {
+      cache_entry_s* lru = NULL;
+      for(uint32_t i = 0; i < IMAGE_CACHE_ENTRIES; i++)
+      {
+        cache_entry_s* entry = &entries[i];
+        if(!entry->filename[0] || entry == except) continue;
+        if(!lru || entry->last_used < lru->last_used) lru = entry;
+      }
+      return lru;
+    }
+
+    static bool heap_short(uint32_t size) //allocating size bytes would leave too small free block for the rest of the firmware
+    {
+      return ESP.getMaxFreeBlockSize() < size + IMAGE_CACHE_MIN_FREE_BLOCK;
+    }
+
+    static cache_entry_s* make_room(uint32_t size) //free entry with size bytes left in the budget and on the heap, NULL if it can't be made
+    {
+      if(size > IMAGE_CACHE_BUDGET) return NULL;
+      while(cached_size + size > IMAGE_CACHE_BUDGET || heap_short(size))
+      {
+        cache_entry_s* lru = least_recently_used(NULL);
+        if(!lru) return NULL;
+        evict(lru);
+      }
+
+      for(uint32_t i = 0; i < IMAGE_CACHE_ENTRIES; i++)
+        if(!entries[i].filename[0]) return &entries[i];
+      cache_entry_s* lru = least_recently_used(NULL);
+      evict(lru);
+      return lru;
+    }
+
+    static cache_entry_s* insert(uint32_t size)
+    {
+      //an image is cached once, an older version of it is replaced
+      invalidate(recorded_filename);
+      cache_entry_s* entry = make_room(size);
+      if(!entry) return NULL;
+      strcpy(entry->filename, recorded_filename);
+      entry->version = recorded_version;
+      entry->size = size;
+      entry->last_used = ++use_counter;
+      cached_size += size;
+      return entry;
+    }
+
+    bool show(const String& filename, uint32_t version, const decoder::sink_s* sink)
+    {
+      cache_entry_s* entry = find(filename.c_str(), version);
+      if(!entry) return false;
+      entry->last_used = ++use_counter;
+
+      //the displayed content is stopped first, so its RAM is free for the copy
+      CRGB* canvas = sink->begin_image();
+      if(entry->image)
+      {
+        memcpy(canvas, entry->image, sink->width * sink->height * sizeof(CRGB));
+        sink->show_image();
+        return true;
+      }
+
+      //the renderer takes over the slab it plays, it gets a copy, other images are evicted if the heap is short for it
+      anim::animation_s animation = {};
+      while(!anim::animation_copy(&animation, &entry->animation))
+      {
+        cache_entry_s* lru = least_recently_used(entry);
+        if(!lru) return false;
+        evict(lru);
+      }
+      sink->show_animation(&animation);
+      return true;
+    }
+
+    static CRGB* record_begin_image()
+    {
+      recorded_canvas = target->begin_image();
+      return recorded_canvas;
+    }
+
+    static void record_show_image()
+    {
+      uint32_t size = target->width * target->height * sizeof(CRGB);
+      cache_entry_s* entry = recorded_canvas ? insert(size) : NULL;
+      if(entry)
+      {
+        entry->image = (CRGB*)malloc(size);
+        if(entry->image) memcpy(entry->image, recorded_canvas, size);
+        else evict(entry);
+      }
+      target->show_image();
+    }
+
+    static void record_show_animation(anim::animation_s* animation)
+    {
+      cache_entry_s* entry = insert(animation->frames_size * sizeof(anim::frame_s) + animation->data_size);
+      if(entry && !anim::animation_copy(&entry->animation, animation)) evict(entry);
+      target->show_animation(animation);
+    }
+
+    static void record_show_source(anim::frame_source_s* source)
+    {
+      target->show_source(source); //decoded during playback, too big to be cached
+    }
+
+    const decoder::sink_s* recording_sink(const String& filename, uint32_t version, const decoder::sink_s* sink)
+    {
+      if(filename.length() >= IMAGE_CACHE_NAME_SIZE) return sink;
+      strcpy(recorded_filename, filename.c_str());
+      recorded_version = version;
+      recorded_canvas = NULL;
+      target = sink;
+
+      recorder = *sink;
+      recorder.begin_image = record_begin_image;
+      recorder.show_image = record_show_image;
+      recorder.show_animation = record_show_animation;
+      recorder.show_source = record_show_source;
+      return &recorder;
+    }
+
+    void trim()
+    {
+      while(heap_short(0))
+      {
+        cache_entry_s* lru = least_recently_used(NULL);
+        if(!lru) return;
+        evict(lru);
+      }
+    }
+
+    void invalidate(const String& filename)
+    {
+      for(uint32_t i = 0; i < IMAGE_CACHE_ENTRIES; i++)
+        if(entries[i].filename[0] && filename == entries[i].filename) evict(&entries[i]);
+    }
+
+    void clear()
+    {
+      for(uint32_t i = 0; i < IMAGE_CACHE_ENTRIES; i++)
+        if(entries[i].filename[0]) evict(&entries[i]);
+    }
+  }
+}
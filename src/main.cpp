@@ -23,4 +23,5 @@ void loop()
   pixelbox::ws2812b_8x8::loop();
   pixelbox::wifi_manager::loop();
   pixelbox::button::loop();
+  pixelbox::state_machine::loop();
 }
\ No newline at end of file
@@ -8,16 +8,79 @@
 
 namespace img_parse
 {
+  //input at the parsing offset, a streamed input holds it in the read buffer (see load)
+  const uint8_t* input(png_parse_context_s& ctx)
+  {
+    return ctx.data + (ctx.offset - ctx.data_offset);
+  }
+
   //PNG byte order to host
   uint32_t read_u32(png_parse_context_s& ctx, uint64_t offset)
   {    
-    return (uint32_t)((uint32_t)(ctx.data[ctx.offset + offset] << 24) + (uint32_t)(ctx.data[ctx.offset + offset + 1] << 16) + (uint32_t)(ctx.data[ctx.offset + offset + 2] << 8) + (uint32_t)(ctx.data[ctx.offset + offset + 3] << 0)); 
+    const uint8_t* p = input(ctx) + offset;
+    return (uint32_t)((uint32_t)(p[0] << 24) + (uint32_t)(p[1] << 16) + (uint32_t)(p[2] << 8) + (uint32_t)(p[3] << 0)); 
   }
 
   //PNG byte order to host
   uint8_t read_u8(png_parse_context_s& ctx, uint64_t offset)
   {
-    return *(ctx.data + ctx.offset + offset);
+    return *(input(ctx) + offset);
+  }
+
+  bool seek_source(png_parse_context_s& ctx, uint32_t position)
+  {
+    if(ctx.source_position == position) return true;
+    if(ctx.seek)
+    {
+      if(!ctx.seek(ctx.user, position)) return false;
+      ctx.source_position = position;
+      return true;
+    }
+
+    //without a seek callback only skipping forward is possible, by reading through the buffer
+    while(ctx.source_position < position)
+    {
+      uint32_t n = position - ctx.source_position < PNG_READ_BUFFER_SIZE ? position - ctx.source_position : PNG_READ_BUFFER_SIZE;
+      if(ctx.read(ctx.user, (uint8_t*)ctx.data, n) != n) return false;
+      ctx.source_position += n;
+    }
+    return ctx.source_position == position;
+  }
+
+  bool load(png_parse_context_s& ctx, uint32_t len)
+  {
+    //make the len bytes at the parsing offset readable, a buffer input has all of them, a stream is read into the read buffer
+    if((uint64_t)ctx.offset + len > ctx.size) return false;
+    if(ctx.read == NULL) return true;
+    if(len > PNG_READ_BUFFER_SIZE) return false;
+    uint32_t end = ctx.data_offset + ctx.data_fill;
+    if(ctx.offset >= ctx.data_offset && ctx.offset + len <= end) return true;
+
+    //bytes already read from the offset on are kept, the rest of the buffer is filled ahead from the source
+    uint32_t keep = 0;
+    if(ctx.offset >= ctx.data_offset && ctx.offset < end)
+    {
+      keep = end - ctx.offset;
+      memmove((uint8_t*)ctx.data, input(ctx), keep);
+    }
+    else if(!seek_source(ctx, ctx.offset)) return false;
+    ctx.data_offset = ctx.offset;
+    ctx.data_fill = keep;
+
+    uint32_t n = PNG_READ_BUFFER_SIZE - keep;
+    if(n > ctx.size - ctx.source_position) n = ctx.size - ctx.source_position;
+    n = ctx.read(ctx.user, (uint8_t*)ctx.data + keep, n);
+    ctx.source_position += n;
+    ctx.data_fill += n;
+    return ctx.data_fill >= len;
+  }
+
+  uint32_t available(png_parse_context_s& ctx)
+  {
+    //bytes at the parsing offset readable without reading the source
+    if(ctx.read == NULL) return ctx.offset < ctx.size ? ctx.size - ctx.offset : 0;
+    uint32_t end = ctx.data_offset + ctx.data_fill;
+    return ctx.offset >= ctx.data_offset && ctx.offset < end ? end - ctx.offset : 0;
   }
 
   bool check_next_chunk(png_parse_context_s& ctx, chunk_data_s& cd)
@@ -26,20 +89,31 @@ namespace img_parse
     if(ctx.offset < 8) return false;
 
     //if remaining bytes not enough for the smallest chunk possible, it's invalid
+    if(ctx.offset > ctx.size) return false;
     uint32_t remaining = ctx.size - ctx.offset;
     if(remaining < 12) return false;    
 
-    //if the chunk would be bigger than the remaining bytes, it's invalid
+    //if the chunk (len, type, data, crc32) would be bigger than the remaining bytes, it's invalid, compared without overflowing
+    if(!load(ctx, 4 + 4)) return false;
     cd.len = read_u32(ctx, 0);
-    if(remaining < (cd.len + 4 + 4)) return false;
-
-    //check the integrity of the chunk with crc32
-    cd.crc32 = read_u32(ctx, cd.len + 4 + 4);
-    uint32_t crc_calc = tinf_crc32(ctx.data + ctx.offset + 4, cd.len + 4);
-    if(cd.crc32 != crc_calc) return false;
+    if(cd.len > remaining - 12) return false;
 
     //read the chunk type
     cd.type = read_u32(ctx, 4);
+
+    //a stream holds only the chunks fitting the read buffer, the bigger ones pass through it: image data has its crc32 checked while inflated, skipped chunks are not checked
+    cd.crc32 = 0;
+    if(ctx.read != NULL && cd.len + 4 + 4 + 4 > PNG_READ_BUFFER_SIZE) return true;
+    if(!load(ctx, cd.len + 4 + 4 + 4)) return false;
+
+    //check the integrity of the chunk with crc32, only once per chunk and not at all if the file was validated before
+    cd.crc32 = read_u32(ctx, cd.len + 4 + 4);
+    if(!ctx.validated && ctx.crc_checked_offset != ctx.offset)
+    {
+      uint32_t crc_calc = tinf_crc32(input(ctx) + 4, cd.len + 4);
+      if(cd.crc32 != crc_calc) return false;
+      ctx.crc_checked_offset = ctx.offset;
+    }
     return true;
   }
 
@@ -59,41 +133,315 @@ namespace img_parse
     ctx.hdr.filter_method = read_u8(ctx, 11);
     ctx.hdr.interlace_method = read_u8(ctx, 12);
 
+    //the image data of non-animated files covers the whole image
+    memset(&ctx.fctl, 0, sizeof(ctx.fctl));
+    ctx.fctl.width = ctx.hdr.width;
+    ctx.fctl.height = ctx.hdr.height;
+
     ctx.offset += cd.len + 4; //data + crc32
     return true;
   }
 
+  bool parse_actl(png_parse_context_s& ctx)
+  {
+    chunk_data_s cd;
+    if(!check_next_chunk(ctx, cd)) return false; //does crc check too
+    if(cd.type != chunk_type_actl) return false;
+    if(cd.len != 8) return false;
+    ctx.offset += 4 + 4; //len, type
+
+    //it must precede the image data, an animation without frames is displayed as a plain PNG
+    uint32_t num_frames = read_u32(ctx, 0);
+    if(!ctx.idat_parsed && !ctx.animated && num_frames > 0)
+    {
+      ctx.num_frames = num_frames;
+      ctx.num_plays = read_u32(ctx, 4);
+      ctx.animated = true;
+    }
+
+    ctx.offset += cd.len + 4; //data + crc32
+    return true;
+  }
+
+  bool parse_fctl(png_parse_context_s& ctx)
+  {
+    chunk_data_s cd;
+    if(!check_next_chunk(ctx, cd)) return false; //does crc check too
+    if(cd.type != chunk_type_fctl) return false;
+    if(cd.len != 26) return false;
+    ctx.offset += 4 + 4; //len, type
+
+    fctl_s fctl;
+    fctl.sequence_number = read_u32(ctx, 0);
+    fctl.width = read_u32(ctx, 4);
+    fctl.height = read_u32(ctx, 8);
+    fctl.x_offset = read_u32(ctx, 12);
+    fctl.y_offset = read_u32(ctx, 16);
+    fctl.delay_num = (read_u8(ctx, 20) << 8) | read_u8(ctx, 21);
+    fctl.delay_den = (read_u8(ctx, 22) << 8) | read_u8(ctx, 23);
+    fctl.dispose_op = read_u8(ctx, 24);
+    fctl.blend_op = read_u8(ctx, 25);
+
+    //the frame's region must be inside the image
+    if(fctl.width == 0 || fctl.height == 0) return false;
+    if((uint64_t)fctl.x_offset + fctl.width > ctx.hdr.width || (uint64_t)fctl.y_offset + fctl.height > ctx.hdr.height) return false;
+    if(fctl.dispose_op > dispose_op_previous || fctl.blend_op > blend_op_over) return false;
+
+    ctx.fctl = fctl;
+    ctx.fctl_pending = true;
+    ctx.offset += cd.len + 4; //data + crc32
+    return true;
+  }
+
+  bool parse_plte(png_parse_context_s& ctx)
+  {
+    chunk_data_s cd;
+    if(!check_next_chunk(ctx, cd)) return false; //does crc check too
+    if(cd.type != chunk_type_plte) return false;
+    if(cd.len == 0 || cd.len % 3 != 0 || cd.len / 3 > 256) return false; //1-256 rgb entries
+
+    //only indexed images need the palette, for others it's just a suggestion for quantization
+    //it must precede the image data and there can be only one
+    if(ctx.hdr.color_type != color_type_palette || ctx.palette != NULL || ctx.idat_parsed)
+    {
+      ctx.offset += cd.len + 4 + 4 + 4; //skip entire chunk (len, type, data, crc32)
+      return true;
+    }
+    ctx.offset += 4 + 4; //len, type
+
+    //room for every index of the bit depth, entries without a PLTE pair are opaque black
+    ctx.palette = (uint8_t*)calloc(256, 4);
+    if(ctx.palette == NULL) return false;
+    ctx.palette_size = cd.len / 3;
+    for(uint32_t i = 0; i < 256; i++)
+    {
+      if(i < ctx.palette_size)
+      {
+        ctx.palette[4*i+0] = read_u8(ctx, 3*i+0);
+        ctx.palette[4*i+1] = read_u8(ctx, 3*i+1);
+        ctx.palette[4*i+2] = read_u8(ctx, 3*i+2);
+      }
+      ctx.palette[4*i+3] = 0xFF;
+    }
+
+    ctx.offset += cd.len + 4; //data + crc32
+    return true;
+  }
+
+  bool parse_trns(png_parse_context_s& ctx)
+  {
+    chunk_data_s cd;
+    if(!check_next_chunk(ctx, cd)) return false; //does crc check too
+    if(cd.type != chunk_type_trns) return false;
+    ctx.offset += 4 + 4; //len, type
+
+    //the layout depends on the color type, types with an alpha channel can't have one and it must precede the image data
+    if(ctx.idat_parsed)
+    {
+      ctx.offset += cd.len + 4; //data + crc32
+      return true;
+    }
+
+    if(ctx.hdr.color_type == color_type_palette)
+    {
+      //alpha of the first palette entries, the rest stays opaque
+      if(ctx.palette == NULL || cd.len > ctx.palette_size) return false;
+      for(uint32_t i = 0; i < cd.len; i++)
+        ctx.palette[4*i+3] = read_u8(ctx, i);
+    }
+    else if(ctx.hdr.color_type == color_type_gray && cd.len == 2)
+    {
+      ctx.trns_key[0] = (read_u8(ctx, 0) << 8) | read_u8(ctx, 1);
+      ctx.trns_key_valid = true;
+    }
+    else if(ctx.hdr.color_type == color_type_rgb && cd.len == 6)
+    {
+      for(uint32_t i = 0; i < 3; i++)
+        ctx.trns_key[i] = (read_u8(ctx, 2*i) << 8) | read_u8(ctx, 2*i+1);
+      ctx.trns_key_valid = true;
+    }
+
+    ctx.offset += cd.len + 4; //data + crc32
+    return true;
+  }
+
+  bool check_format(png_parse_context_s& ctx)
+  {
+    //allowed bit depths of the color types, see RFC @ 4.1.1
+    uint8_t bd = ctx.hdr.bit_depth;
+    bool low_depth = bd == 1 || bd == 2 || bd == 4;
+    switch (ctx.hdr.color_type)
+    {
+    case color_type_gray:
+      if(!low_depth && bd != 8 && bd != 16) return false;
+      ctx.channels = 1;
+      break;
+    case color_type_rgb:
+      if(bd != 8 && bd != 16) return false;
+      ctx.channels = 3;
+      break;
+    case color_type_palette:
+      if(!low_depth && bd != 8) return false;
+      ctx.channels = 1;
+      break;
+    case color_type_gray_alpha:
+      if(bd != 8 && bd != 16) return false;
+      ctx.channels = 2;
+      break;
+    case color_type_rgba:
+      if(bd != 8 && bd != 16) return false;
+      ctx.channels = 4;
+      break;
+    default:
+      return false;
+    }
+
+    //only deflate, adaptive filtering and non-interlaced images are supported
+    if(ctx.hdr.compression_method != 0 || ctx.hdr.filter_method != 0 || ctx.hdr.interlace_method != 0) return false;
+
+    uint32_t bits = ctx.channels * bd;
+    ctx.pixel_size = bits < 8 ? 1 : bits / 8;
+    return true;
+  }
+
   uint8_t paeth_predictor(uint8_t a, uint8_t b, uint8_t c)
   {
-    // see RFC @ 6.6 below
-    
-    int p = a + b - c;
-    int pa = abs(p - a);
-    int pb = abs(p - b);
-    int pc = abs(p - c);
-    int pr;
-    if(pa <= pb && pa <= pc)
-        pr = a;
-    else if(pb <= pc)
-        pr = b;
-    else
-        pr = c;
-    return pr;
+    // see RFC @ 6.6 below, with p - a = b - c, p - b = a - c and p - c = (b - c) + (a - c)
+    // the ties are broken in the same order, selecting without branches
+
+    int pa = b - c;
+    int pb = a - c;
+    int pc = pa + pb;
+    pa = pa < 0 ? -pa : pa;
+    pb = pb < 0 ? -pb : pb;
+    pc = pc < 0 ? -pc : pc;
+    uint8_t pr = pa <= pb ? a : b;
+    int pr_dist = pa <= pb ? pa : pb;
+    return pr_dist <= pc ? pr : c;
+  }
+
+  //32 bit SWAR, four bytes are processed at once in a word, each one modulo 256
+  inline uint32_t load_u32(const uint8_t* p)
+  {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+  }
+
+  inline void store_u32(uint8_t* p, uint32_t v)
+  {
+    memcpy(p, &v, 4);
   }
 
-  void unfilter_scanline(png_parse_context_s& ctx)
+  inline uint32_t swar_add(uint32_t x, uint32_t y) //x + y bytewise, the low 7 bits are added then the top bits xor-ed in so carries don't cross bytes
+  {
+    return ((x & 0x7F7F7F7F) + (y & 0x7F7F7F7F)) ^ ((x ^ y) & 0x80808080);
+  }
+
+  inline uint32_t swar_avg(uint32_t x, uint32_t y) //floor((x + y) / 2) bytewise without 9 bit intermediates
+  {
+    return (x & y) + (((x ^ y) & 0xFEFEFEFE) >> 1);
+  }
+
+  //unfilter kernels, specialized for the bytes per pixel so the inner pixel loops are unrolled (also at -Os) and the left pixel stays in registers, the stride is always a multiple of bpp
+  //the scanlines start 4 byte aligned (see parse_idat), the SWAR paths are used when the left neighbour is whole words back (bpp 4 and 8)
+  //the first pixel (no left neighbour) and the first scanline (no prior) are handled separately instead of checked per byte
+
+  template<uint32_t bpp> void unfilter_sub(uint8_t* raw, uint32_t stride)
+  {
+    if(bpp % 4 == 0)
+    {
+      raw = (uint8_t*)__builtin_assume_aligned(raw, 4);
+      for(uint32_t i = bpp; i < stride; i += 4)
+        store_u32(raw + i, swar_add(load_u32(raw + i), load_u32(raw + i - bpp)));
+      return;
+    }
+    uint8_t left[bpp]; //the left neighbour is kept in registers instead of reloaded right after it was stored
+    for(uint32_t k = 0; k < bpp; k++)
+      left[k] = raw[k];
+    for(uint32_t i = bpp; i < stride; i += bpp)
+    {
+      #pragma GCC unroll 8
+      for(uint32_t k = 0; k < bpp; k++)
+        left[k] = raw[i + k] += left[k];
+    }
+  }
+
+  void unfilter_up(uint8_t* raw, const uint8_t* prior, uint32_t stride)
+  {
+    raw = (uint8_t*)__builtin_assume_aligned(raw, 4);
+    prior = (const uint8_t*)__builtin_assume_aligned(prior, 4);
+    uint32_t i = 0;
+    for(; i + 4 <= stride; i += 4)
+      store_u32(raw + i, swar_add(load_u32(raw + i), load_u32(prior + i)));
+    for(; i < stride; i++)
+      raw[i] += prior[i];
+  }
+
+  template<uint32_t bpp> void unfilter_avg(uint8_t* raw, const uint8_t* prior, uint32_t stride)
+  {
+    for(uint32_t k = 0; k < bpp; k++)
+      raw[k] += prior[k] >> 1;
+    if(bpp % 4 == 0)
+    {
+      raw = (uint8_t*)__builtin_assume_aligned(raw, 4);
+      prior = (const uint8_t*)__builtin_assume_aligned(prior, 4);
+      for(uint32_t i = bpp; i < stride; i += 4)
+        store_u32(raw + i, swar_add(load_u32(raw + i), swar_avg(load_u32(raw + i - bpp), load_u32(prior + i))));
+      return;
+    }
+    uint8_t left[bpp];
+    for(uint32_t k = 0; k < bpp; k++)
+      left[k] = raw[k];
+    for(uint32_t i = bpp; i < stride; i += bpp)
+    {
+      #pragma GCC unroll 8
+      for(uint32_t k = 0; k < bpp; k++)
+        left[k] = raw[i + k] += (left[k] + prior[i + k]) >> 1;
+    }
+  }
+
+  template<uint32_t bpp> void unfilter_avg_first(uint8_t* raw, uint32_t stride) //prior is zero
+  {
+    uint8_t left[bpp];
+    for(uint32_t k = 0; k < bpp; k++)
+      left[k] = raw[k];
+    for(uint32_t i = bpp; i < stride; i += bpp)
+    {
+      #pragma GCC unroll 8
+      for(uint32_t k = 0; k < bpp; k++)
+        left[k] = raw[i + k] += left[k] >> 1;
+    }
+  }
+
+  template<uint32_t bpp> void unfilter_paeth(uint8_t* raw, const uint8_t* prior, uint32_t stride)
+  {
+    uint8_t left[bpp];
+    for(uint32_t k = 0; k < bpp; k++)
+      left[k] = raw[k] += prior[k]; //left and upper left are zero, the predictor is the one above
+    for(uint32_t i = bpp; i < stride; i += bpp)
+    {
+      #pragma GCC unroll 8
+      for(uint32_t k = 0; k < bpp; k++)
+        left[k] = raw[i + k] += paeth_predictor(left[k], prior[i + k], prior[i + k - bpp]);
+    }
+  }
+
+  template<uint32_t bpp> bool unfilter_scanline(png_parse_context_s& ctx)
   {
     //PNG images can be filtered: https://www.rfc-editor.org/rfc/rfc2083#page-31
     //in order to reconstruct the image, we need to unfilter scanlines (rows) of the image
+    //the scanline is unfiltered in place, the filters reduce to simpler ones on the first scanline where prior is zero
 
-    uint8_t filter_method = *(ctx.inflated_data + (ctx.stride + 1) * ctx.scanline_index);
+    uint8_t filter_method = ctx.row[0];
+    bool first = ctx.scanline_index == 0;
+    uint32_t stride = ctx.stride;
+    uint8_t* raw = ctx.row + 1;
+    const uint8_t* prior = ctx.prev_row + 1;
     switch (filter_method)
     {
     case filter_method_none:
     {
-      memcpy(ctx.unfiltered_data + ctx.stride * ctx.scanline_index, 
-             ctx.inflated_data + (ctx.stride + 1) * ctx.scanline_index + 1,
-             ctx.stride);
       break;
     }
     case filter_method_sub:
@@ -126,14 +474,7 @@ namespace img_parse
       //    Sub(x) + Raw(x-bpp)
       // (computed mod 256), where Raw refers to the bytes already decoded.
 
-      for(uint32_t i = 0; i < ctx.stride; i++)
-      {
-        ctx.unfiltered_data[ctx.stride * ctx.scanline_index + i] = ctx.inflated_data[(ctx.stride + 1) * ctx.scanline_index + 1 + i];
-        if(i < ctx.pixel_size)
-          continue;
-        else
-          ctx.unfiltered_data[ctx.stride * ctx.scanline_index + i] += ctx.unfiltered_data[ctx.stride * ctx.scanline_index  + i - ctx.pixel_size];
-      }
+      unfilter_sub<bpp>(raw, stride);
       break;
     }
     case filter_method_up:
@@ -161,14 +502,7 @@ namespace img_parse
       // (computed mod 256), where Prior refers to the decoded bytes of the
       // prior scanline.
 
-      for(uint32_t i = 0; i < ctx.stride; i++)
-      {
-        ctx.unfiltered_data[ctx.stride * ctx.scanline_index + i] = ctx.inflated_data[(ctx.stride + 1) * ctx.scanline_index + 1 + i];
-        if(ctx.scanline_index == 0)
-          return;
-        else
-          ctx.unfiltered_data[ctx.stride * ctx.scanline_index + i] += ctx.unfiltered_data[ctx.stride * (ctx.scanline_index - 1) + i];
-      }
+      if(!first) unfilter_up(raw, prior, stride);
       break;
     }
     case filter_method_avg:
@@ -205,19 +539,8 @@ namespace img_parse
       // bytes already decoded, and Prior refers to the decoded bytes of
       // the prior scanline.
 
-      for(uint32_t i = 0; i < ctx.stride; i++)
-      {
-        ctx.unfiltered_data[ctx.stride * ctx.scanline_index + i] = ctx.inflated_data[(ctx.stride + 1) * ctx.scanline_index + 1 + i];
-
-        uint8_t r_a = 0;
-        uint8_t r_b = 0;
-        if(i >= ctx.pixel_size)
-          r_a = ctx.unfiltered_data[ctx.stride * ctx.scanline_index  + i - ctx.pixel_size];
-        if(ctx.scanline_index > 0)
-          r_b = ctx.unfiltered_data[ctx.stride * (ctx.scanline_index - 1) + i];
-
-        ctx.unfiltered_data[ctx.stride * ctx.scanline_index + i] += (r_a + r_b) / 2;
-      }
+      if(first) unfilter_avg_first<bpp>(raw, stride);
+      else unfilter_avg<bpp>(raw, prior, stride);
       break;
     }
     case filter_method_paeth:
@@ -273,89 +596,216 @@ namespace img_parse
       // decoded.  Exactly the same PaethPredictor function is used by both
       // encoder and decoder.
 
-      for(uint32_t i = 0; i < ctx.stride; i++)
-      {
-        ctx.unfiltered_data[ctx.stride * ctx.scanline_index + i] = ctx.inflated_data[(ctx.stride + 1) * ctx.scanline_index + 1 + i];
-
-        uint8_t r_a = 0;
-        uint8_t r_b = 0;
-        uint8_t r_c = 0;
-        if(i >= ctx.pixel_size)
-          r_a = ctx.unfiltered_data[ctx.stride * ctx.scanline_index  + i - ctx.pixel_size];
-        if(ctx.scanline_index > 0)
-          r_b = ctx.unfiltered_data[ctx.stride * (ctx.scanline_index - 1) + i];
-        if(i >= ctx.pixel_size && ctx.scanline_index > 0)
-          r_c = ctx.unfiltered_data[ctx.stride * (ctx.scanline_index - 1) + i - ctx.pixel_size];
-
-        ctx.unfiltered_data[ctx.stride * ctx.scanline_index + i] += paeth_predictor(r_a, r_b, r_c);
-      }
+      //with a zero prior the predictor is always the left neighbour, that's the Sub filter
+      if(first) unfilter_sub<bpp>(raw, stride);
+      else unfilter_paeth<bpp>(raw, prior, stride);
       break;
     }
     default:
-      return;
-      break;
+      return false; //invalid filter method
     }
+    return true;
   }
 
-  bool parse_idat(png_parse_context_s& ctx)
+  bool unfilter_scanline(png_parse_context_s& ctx)
   {
-    chunk_data_s cd;
+    //select the kernels of the pixel size, these are all the possible ones (low bit depths round up to 1)
+    switch (ctx.pixel_size)
+    {
+    case 1: return unfilter_scanline<1>(ctx);
+    case 2: return unfilter_scanline<2>(ctx);
+    case 3: return unfilter_scanline<3>(ctx);
+    case 4: return unfilter_scanline<4>(ctx);
+    case 6: return unfilter_scanline<6>(ctx);
+    case 8: return unfilter_scanline<8>(ctx);
+    default: return false;
+    }
+  }
 
-    //sanity check    
-    if(!check_next_chunk(ctx, cd)) return false; //does crc check too
-    if(cd.type != chunk_type_idat) return false;
-    if(cd.len < 7) return false;
-    ctx.offset += 4 + 4; //len, type
+  bool read_data(png_parse_context_s& ctx, const uint8_t** data, uint32_t* len)
+  {
+    //next part of the image data chunk's data, the whole rest of it from a buffer input, at most a read buffer from a stream
+    uint32_t n = available(ctx);
+    if(n == 0)
+    {
+      if(!load(ctx, ctx.data_left < PNG_READ_BUFFER_SIZE ? ctx.data_left : PNG_READ_BUFFER_SIZE)) return false;
+      n = available(ctx);
+    }
+    if(n > ctx.data_left) n = ctx.data_left;
+    *data = input(ctx);
+    *len = n;
+    if(ctx.data_crc_pending) ctx.data_crc = tinf_crc32_update(ctx.data_crc, *data, n);
+    ctx.offset += n;
+    ctx.data_left -= n;
+    return true;
+  }
 
-    //allocate buffer for inflated data, can be calculated based on the ihdr data
-    ctx.inflated_data = (uint8_t*)calloc(ctx.hdr.height * (1 + ctx.hdr.width * ctx.pixel_size), 1);
-    if(ctx.inflated_data == NULL) return false;
-    ctx.inflated_size = ctx.hdr.height * (1 + ctx.hdr.width * ctx.pixel_size);
+  bool end_data_chunk(png_parse_context_s& ctx)
+  {
+    //the rest of the image data chunk (eg. the adler32 after the deflate data) and its crc32
+    const uint8_t* data;
+    uint32_t len;
+    while(ctx.data_left)
+      if(!read_data(ctx, &data, &len)) return false;
+    if(!load(ctx, 4)) return false;
+    if(ctx.data_crc_pending && read_u32(ctx, 0) != ctx.data_crc) return false;
+    ctx.offset += 4; //crc32
+    ctx.data_chunk = false;
+    return true;
+  }
 
-    //uncompress data with the excellent tinf library
-    int ret = tinf_uncompress(ctx.inflated_data, &ctx.inflated_size, ctx.data + ctx.offset + 2, cd.len);
-    if(ret != TINF_OK)
+  int inflate_read(void* user, const unsigned char** data, unsigned int* len)
+  {
+    //tinf read callback, supplies the data of the consecutive IDAT (or fdAT) chunks part by part
+    png_parse_context_s& ctx = *(png_parse_context_s*)user;
+    chunk_data_s cd;
+    while(true)
     {
-      free(ctx.inflated_data);
-      ctx.inflated_data = NULL;
-      ctx.inflated_size = 0;
-      return false;
+      if(ctx.data_chunk && ctx.data_left == 0 && !end_data_chunk(ctx)) return 0;
+      if(!ctx.data_chunk)
+      {
+        if(!check_next_chunk(ctx, cd)) return 0; //does crc check too
+        if(cd.type != ctx.data_type) return 0; //end of image data
+        if(cd.type == chunk_type_fdat && cd.len < 4) return 0;
+
+        //chunks not checked whole by check_next_chunk get their crc32 computed while inflating
+        ctx.data_crc_pending = !ctx.validated && ctx.crc_checked_offset != ctx.offset;
+        ctx.data_crc = ctx.data_crc_pending ? tinf_crc32_update(0, input(ctx) + 4, 4) : 0;
+        ctx.offset += 4 + 4; //len, type
+        ctx.data_left = cd.len;
+        ctx.sequence_left = cd.type == chunk_type_fdat ? 4 : 0;
+        ctx.data_chunk = true;
+        continue;
+      }
+
+      const uint8_t* part;
+      uint32_t n;
+      if(!read_data(ctx, &part, &n)) return 0;
+
+      //fdAT data is preceded by its sequence number and the deflate data starts after the zlib header, both can be split between parts
+      uint32_t skip = n < ctx.sequence_left ? n : ctx.sequence_left;
+      ctx.sequence_left -= skip;
+      part += skip;
+      n -= skip;
+      skip = n < ctx.zlib_header_left ? n : ctx.zlib_header_left;
+      ctx.zlib_header_left -= skip;
+      part += skip;
+      n -= skip;
+      if(n)
+      {
+        *data = part;
+        *len = n;
+        return 1;
+      }
     }
+  }
 
-    //check the inflated size if it matches the ihdr based size
-    if(ctx.inflated_size != ctx.hdr.height * (1 + ctx.hdr.width * ctx.pixel_size))
+  int inflate_write(void* user, const unsigned char* data, unsigned int len)
+  {
+    //tinf write callback, collects the inflated bytes into scanlines and unfilters every completed one
+    png_parse_context_s& ctx = *(png_parse_context_s*)user;
+    while(len)
     {
-      free(ctx.inflated_data);
-      ctx.inflated_data = NULL;
-      ctx.inflated_size = 0;
-      return false;
+      if(ctx.scanline_index >= ctx.fctl.height) return TINF_DATA_ERROR; //more data than the ihdr (or fctl) describes
+
+      uint32_t n = ctx.stride + 1 - ctx.row_fill;
+      if(n > len) n = len;
+      memcpy(ctx.row + ctx.row_fill, data, n);
+      ctx.row_fill += n;
+      data += n;
+      len -= n;
+      if(ctx.row_fill < ctx.stride + 1) break;
+
+      if(!unfilter_scanline(ctx)) return TINF_DATA_ERROR;
+      if(!ctx.sink(ctx.sink_user, ctx.scanline_index, ctx.row + 1, ctx.stride)) return TINF_DATA_ERROR;
+
+      //the unfiltered scanline becomes the prior of the next one
+      uint8_t* prev_row = ctx.prev_row;
+      ctx.prev_row = ctx.row;
+      ctx.row = prev_row;
+      ctx.row_fill = 0;
+      ctx.scanline_index++;
     }
+    return TINF_OK;
+  }
+
+  void free_idat_buffers(png_parse_context_s& ctx)
+  {
+    if(ctx.window) free(ctx.window);
+    if(ctx.rows) free(ctx.rows);
+    ctx.window = NULL;
+    ctx.window_size = 0;
+    ctx.rows = NULL;
+    ctx.row = NULL;
+    ctx.prev_row = NULL;
+  }
 
-    //calculate how much byte represents one scanline
-    ctx.stride = ctx.hdr.width * ctx.pixel_size;
+  bool decode_image_data(png_parse_context_s& ctx, uint32_t type)
+  {
+    //decodes the fctl region from the consecutive chunks of the type (IDAT or fdAT), the image data of the default image and of the APNG frames is the same
+    //indexed images need their palette before the image data
+    if(ctx.hdr.color_type == color_type_palette && ctx.palette == NULL) return false;
 
-    //allocated buffor for the image representation
-    ctx.unfiltered_data = (uint8_t*)calloc(ctx.hdr.height * ctx.stride, 1);
-    if(ctx.unfiltered_data == NULL)
+    //calculate how much byte represents one scanline, low bit depth pixels are packed into bytes
+    uint64_t stride = ((uint64_t)ctx.fctl.width * ctx.channels * ctx.hdr.bit_depth + 7) / 8;
+    uint64_t inflated_size = (uint64_t)ctx.fctl.height * (1 + stride);
+    if(ctx.fctl.width == 0 || ctx.fctl.height == 0 || inflated_size > 0xFFFFFFFF) return false;
+    ctx.stride = stride;
+
+    //the window doesn't have to be bigger than the whole inflated data
+    ctx.window_size = 1;
+    while(ctx.window_size < inflated_size && ctx.window_size < PNG_INFLATE_WINDOW_SIZE) ctx.window_size <<= 1;
+    bool fast = inflated_size >= PNG_INFLATE_FAST_MIN_SIZE;
+    ctx.window = (uint8_t*)malloc(ctx.window_size + (fast ? TINF_WORKSPACE_SIZE : 0)); //the huffman lookup tables of tinf follow the window
+    //every scanline buffer starts with 3 bytes of padding and the filter method byte so the scanline data is 4 byte aligned for the SWAR kernels
+    uint32_t row_size = 4 + ((ctx.stride + 3) & ~3);
+    ctx.rows = (uint8_t*)calloc(2 * row_size, 1);
+    if(ctx.window == NULL || ctx.rows == NULL)
     {
-      free(ctx.inflated_data);
-      ctx.inflated_data = NULL;
-      ctx.inflated_size = 0;
+      free_idat_buffers(ctx);
       return false;
     }
-    ctx.unfiltered_size = ctx.hdr.height * ctx.stride;
+    ctx.row = ctx.rows + 3;
+    ctx.prev_row = ctx.rows + row_size + 3;
+    ctx.row_fill = 0;
+    ctx.scanline_index = 0;
+    ctx.data_type = type;
+    ctx.zlib_header_left = 2;
+    ctx.data_chunk = false;
 
-    //unfilter the inflated data
-    for(ctx.scanline_index = 0; ctx.scanline_index < ctx.hdr.height; ctx.scanline_index++)
-      unfilter_scanline(ctx);
+    //uncompress data with the excellent tinf library, reading every consecutive chunk of the type
+    int ret = tinf_uncompress_stream(ctx.window, ctx.window_size, inflate_read, inflate_write, &ctx, NULL, fast ? ctx.window + ctx.window_size : NULL);
+    bool complete = ctx.scanline_index == ctx.fctl.height;
+    if(ret == TINF_OK && ctx.data_chunk && !end_data_chunk(ctx)) ret = TINF_DATA_ERROR; //the chunk holding the end of the deflate data
 
-    //we don't need the infalted data buffer any more, deallocating it
-    free(ctx.inflated_data);
-    ctx.inflated_data = NULL;
-    ctx.inflated_size = 0;
+    //we don't need the inflate buffers any more, deallocating them
+    free_idat_buffers(ctx);
+    return ret == TINF_OK && complete;
+  }
 
-    //adjusting parsing offset
-    ctx.offset += cd.len + 4; //data + crc32
+  bool parse_idat(png_parse_context_s& ctx)
+  {
+    chunk_data_s cd;
+
+    //sanity check    
+    if(!check_next_chunk(ctx, cd)) return false; //does crc check too
+    if(cd.type != chunk_type_idat) return false;
+
+    //image data was decoded from the previous IDAT chunks, this one can only hold the rest of the zlib stream (adler32)
+    if(ctx.idat_parsed)
+    {
+      ctx.offset += cd.len + 4 + 4 + 4; //skip entire chunk (len, type, data, crc32)
+      return true;
+    }
+
+    //the default image is the whole image, even if an APNG frame control was parsed before
+    ctx.fctl.width = ctx.hdr.width;
+    ctx.fctl.height = ctx.hdr.height;
+    ctx.fctl.x_offset = 0;
+    ctx.fctl.y_offset = 0;
+    if(!decode_image_data(ctx, chunk_type_idat)) return false;
+
+    ctx.idat_parsed = true;
     return true;
   }
 
@@ -385,11 +835,26 @@ namespace img_parse
       if(!parse_ihdr(ctx)) return false;
       break;
     }
+    case chunk_type_plte: //palette
+    {
+      if(!parse_plte(ctx)) return false;
+      break;
+    }
+    case chunk_type_trns: //transparency
+    {
+      if(!parse_trns(ctx)) return false;
+      break;
+    }
     case chunk_type_idat: //data
     {
       if(!parse_idat(ctx)) return false;
       break;
     }
+    case chunk_type_actl: //APNG animation control, the frames themselves are decoded by parse_next_frame
+    {
+      if(!parse_actl(ctx)) return false;
+      break;
+    }
     case chunk_type_iend: //end/terminator chunk
     {
       if(!parse_iend(ctx)) return false;
@@ -409,78 +874,459 @@ namespace img_parse
     //sanity check of context
     if(ctx.size < 8) return false;
     if(ctx.offset != 0) return false;
+    if(!load(ctx, 8)) return false;
 
-    if(ctx.data[0] != 0x89) return false;
+    if(read_u8(ctx, 0) != 0x89) return false;
 
     //ASCII 'PNG'
-    if(ctx.data[1] != 0x50) return false;
-    if(ctx.data[2] != 0x4E) return false;
-    if(ctx.data[3] != 0x47) return false;
+    if(read_u8(ctx, 1) != 0x50) return false;
+    if(read_u8(ctx, 2) != 0x4E) return false;
+    if(read_u8(ctx, 3) != 0x47) return false;
 
     //DOS style line ending
-    if(ctx.data[4] != 0x0D) return false;
-    if(ctx.data[5] != 0x0A) return false;
+    if(read_u8(ctx, 4) != 0x0D) return false;
+    if(read_u8(ctx, 5) != 0x0A) return false;
 
     //DOS style EOF
-    if(ctx.data[6] != 0x1A) return false;
+    if(read_u8(ctx, 6) != 0x1A) return false;
 
     //UNIX style line ending
-    if(ctx.data[7] != 0x0A) return false;
+    if(read_u8(ctx, 7) != 0x0A) return false;
 
     //move the offset of the parsing
     ctx.offset += 8;
     return true;
   }
 
-  bool init(png_parse_context_s& ctx, uint8_t* data, uint32_t len)
+  bool init(png_parse_context_s& ctx, const uint8_t* data, uint32_t len)
+  {
+    if(data == NULL) return false;
+
+    //allooc memory for input data
+    uint8_t* copy = (uint8_t*)calloc(len, 1);
+    if(copy == NULL) return false;
+
+    //copy input data to the context
+    memcpy(copy, data, len);
+    return init_owned(ctx, copy, len);
+  }
+
+  bool init_borrowed(png_parse_context_s& ctx, const uint8_t* data, uint32_t len)
   {
+    if(data == NULL) return false;
+
     //zero everything in context
     memset(&ctx, 0, sizeof(ctx));
 
-    //allooc memory for input data
-    ctx.data = (uint8_t*)calloc(len, 1);
-    if(ctx.data == NULL) return false;
+    //the input is only read, no need for a copy
+    ctx.data = data;
     ctx.size = len;
+    ctx.data_owned = false;
+    return true;
+  }
 
-    //copy input data to the context
-    memcpy(ctx.data, data, ctx.size);
+  bool init_owned(png_parse_context_s& ctx, uint8_t* data, uint32_t len)
+  {
+    if(!init_borrowed(ctx, data, len)) return false;
+    ctx.data_owned = true;
     return true;
   }
 
+  bool init(png_parse_context_s& ctx, read_cb read, seek_cb seek, void* user, uint32_t len)
+  {
+    if(read == NULL) return false;
+
+    //the context owns the read buffer, the chunks are read into it one by one
+    uint8_t* buffer = (uint8_t*)malloc(PNG_READ_BUFFER_SIZE);
+    if(buffer == NULL) return false;
+    init_owned(ctx, buffer, len);
+    ctx.read = read;
+    ctx.seek = seek;
+    ctx.user = user;
+    return true;
+  }
+
+  void release_data(png_parse_context_s& ctx)
+  {
+    //only owned input is freed, borrowed input is just forgotten
+    if(ctx.data && ctx.data_owned) free((void*)ctx.data);
+    ctx.data = NULL;
+    ctx.size = 0;
+    ctx.data_owned = false;
+  }
+
   void deinit(png_parse_context_s& ctx)
   {
     //free all allocated memory
-    if(ctx.data) free(ctx.data);
-    if(ctx.inflated_data) free(ctx.inflated_data);
+    release_data(ctx);
+    free_idat_buffers(ctx);
     if(ctx.unfiltered_data) free(ctx.unfiltered_data);
+    if(ctx.palette) free(ctx.palette);
+    if(ctx.output_palette) free(ctx.output_palette);
     //zero everything
     memset(&ctx, 0, sizeof(ctx));
   }
 
+  bool store_row(void* user, uint32_t y, const uint8_t* row, uint32_t len)
+  {
+    //sink of parse, collects the scanlines into the whole image
+    png_parse_context_s& ctx = *(png_parse_context_s*)user;
+    if(ctx.unfiltered_data == NULL)
+    {
+      ctx.unfiltered_data = (uint8_t*)malloc(ctx.fctl.height * len);
+      if(ctx.unfiltered_data == NULL) return false;
+      ctx.unfiltered_size = ctx.fctl.height * len;
+    }
+    memcpy(ctx.unfiltered_data + y * len, row, len);
+    return true;
+  }
+
   bool parse(png_parse_context_s& ctx)
   {
+    return parse_rows(ctx, store_row, &ctx);
+  }
+
+  bool parse_header(png_parse_context_s& ctx)
+  {
+    if(ctx.header_parsed) return true;
+
     //check the png header and the first ihdr
     if(!check_header(ctx)) return false;
     if(!parse_ihdr(ctx)) return false;
 
-    //only supporting 32bit rgba or 24bit rgb pixel data
-    if(ctx.hdr.bit_depth != 8) return false; 
+    //every color type and bit depth of the standard is supported
+    if(!check_format(ctx)) return false;
 
-    if(ctx.hdr.color_type == 6)
-      ctx.pixel_size = 4;
-    else if(ctx.hdr.color_type == 2)
-      ctx.pixel_size = 3;
-    else
-      return false;
+    //palette, transparency and animation control precede the image data, the first frame control or IDAT chunk ends the header
+    chunk_data_s cd;
+    while(true)
+    {
+      if(!check_next_chunk(ctx, cd)) return false; //does crc check too
+      if(cd.type == chunk_type_idat || cd.type == chunk_type_fctl || cd.type == chunk_type_iend) break;
+      if(!parse_next_chunk(ctx)) return false;
+    }
+
+    ctx.frames_offset = ctx.offset;
+    ctx.header_parsed = true;
+    return true;
+  }
+
+  bool parse_rows(png_parse_context_s& ctx, row_cb sink, void* user)
+  {
+    if(sink == NULL) return false;
+    ctx.sink = sink;
+    ctx.sink_user = user;
+
+    //check the png header, the first ihdr and the chunks before the image data (if it wasn't done with parse_header)
+    if(!parse_header(ctx)) return false;
 
     //parse the following chunks until the first iend chunk is not found
     while (!ctx.parsed)
       if(!parse_next_chunk(ctx)) return false;
+    if(!ctx.idat_parsed) return false; //there was no image data
 
     //deallocate raw input buffer
-    free(ctx.data);
-    ctx.data = NULL;
-    ctx.size = 0;
+    release_data(ctx);
     return true;
   }
+
+  void set_background(png_parse_context_s& ctx, uint8_t r, uint8_t g, uint8_t b)
+  {
+    ctx.background[0] = r;
+    ctx.background[1] = g;
+    ctx.background[2] = b;
+  }
+
+  uint16_t read_sample(const uint8_t* row, uint32_t i, uint8_t bit_depth)
+  {
+    //i-th sample of the scanline, samples below 8 bits are packed from the most significant bit
+    if(bit_depth == 16) return (row[2*i] << 8) | row[2*i+1];
+    if(bit_depth == 8) return row[i];
+    uint32_t bit = i * bit_depth;
+    return (row[bit >> 3] >> (8 - bit_depth - (bit & 7))) & ((1 << bit_depth) - 1);
+  }
+
+  uint8_t blend(uint8_t c, uint8_t a, uint8_t bg)
+  {
+    //c * a / 255 + bg * (255 - a) / 255, rounded, without a division
+    uint32_t x = c * a + bg * (255 - a) + 128;
+    return (x + (x >> 8)) >> 8;
+  }
+
+  template<uint8_t bd> void palette_row(uint8_t* out, const uint8_t* row, const uint8_t* palette, uint32_t width)
+  {
+    //indices are unpacked a byte at a time (8 / bd pixels each) and looked up right into the output
+    const uint8_t per_byte = 8 / bd;
+    const uint8_t mask = (1 << bd) - 1;
+    uint32_t x = 0;
+    for(; x + per_byte <= width; x += per_byte, row++)
+    {
+      uint8_t packed = *row;
+      #pragma GCC unroll 8
+      for(uint8_t k = 0; k < per_byte; k++, out += 3)
+        memcpy(out, palette + 3 * ((packed >> (8 - bd * (k + 1))) & mask), 3);
+    }
+    for(uint8_t k = 0; x < width; k++, x++, out += 3) //last pixels of a partially used byte
+      memcpy(out, palette + 3 * ((*row >> (8 - bd * (k + 1))) & mask), 3);
+  }
+
+  inline void set_mask_bit(uint8_t* mask, uint32_t i)
+  {
+    mask[i / 8] |= 1 << (i % 8);
+  }
+
+  bool rgb_row(void* user, uint32_t y, const uint8_t* row, uint32_t /*len*/)
+  {
+    //sink of parse_rgb, converts the scanline to rgb triplets right in the output
+    png_parse_context_s& ctx = *(png_parse_context_s*)user;
+    uint32_t width = ctx.fctl.width;
+    if((uint64_t)(y + 1) * width * 3 > ctx.output_size) return false; //output too small
+    uint8_t* out = ctx.output + y * width * 3;
+    uint8_t bd = ctx.hdr.bit_depth;
+    const uint8_t* bg = ctx.background;
+    uint8_t* mask = ctx.output_mask;
+    uint32_t mask_bit = y * width; //bit of the first pixel of the scanline
+    const uint8_t* backdrop = ctx.output_backdrop ? ctx.output_backdrop + 3 * ((uint64_t)(ctx.fctl.y_offset + y) * ctx.hdr.width + ctx.fctl.x_offset) : NULL; //under the first pixel of the scanline
+
+    if(ctx.hdr.color_type == color_type_palette)
+    {
+      //the palette is composited over the background once, then pixels are just looked up
+      if(ctx.output_palette == NULL)
+      {
+        ctx.output_palette = (uint8_t*)malloc(256 * 3);
+        if(ctx.output_palette == NULL) return false;
+        for(uint32_t i = 0; i < 256; i++)
+          for(uint32_t c = 0; c < 3; c++)
+            ctx.output_palette[3*i+c] = blend(ctx.palette[4*i+c], ctx.palette[4*i+3], bg[c]);
+      }
+      switch (bd)
+      {
+      case 1: palette_row<1>(out, row, ctx.output_palette, width); break;
+      case 2: palette_row<2>(out, row, ctx.output_palette, width); break;
+      case 4: palette_row<4>(out, row, ctx.output_palette, width); break;
+      default: palette_row<8>(out, row, ctx.output_palette, width); break;
+      }
+      if(mask || backdrop)
+      {
+        for(uint32_t x = 0; x < width; x++)
+        {
+          const uint8_t* entry = ctx.palette + 4 * read_sample(row, x, bd);
+          if(entry[3] == 0xFF) continue;
+          if(entry[3] == 0 && mask) set_mask_bit(mask, mask_bit + x);
+          if(backdrop)
+            for(uint32_t c = 0; c < 3; c++)
+              out[3*x+c] = blend(entry[c], entry[3], backdrop[3*x+c]);
+        }
+      }
+      return true;
+    }
+
+    if(ctx.hdr.color_type == color_type_rgb && bd == 8 && !ctx.trns_key_valid)
+    {
+      memcpy(out, row, width * 3); //already in the output format
+      return true;
+    }
+
+    if(ctx.hdr.color_type == color_type_rgba && bd == 8)
+    {
+      //the most common alpha format, opaque pixels are just copied
+      for(uint32_t x = 0; x < width; x++, out += 3, row += 4)
+      {
+        uint8_t a = row[3];
+        if(a == 0xFF) memcpy(out, row, 3);
+        else
+        {
+          if(a == 0 && mask) set_mask_bit(mask, mask_bit + x);
+          const uint8_t* under = backdrop ? backdrop + 3 * x : bg;
+          out[0] = blend(row[0], a, under[0]);
+          out[1] = blend(row[1], a, under[1]);
+          out[2] = blend(row[2], a, under[2]);
+        }
+      }
+      return true;
+    }
+
+    //samples are scaled to 8 bits: 16 bit ones are truncated, low bit depth gray is replicated (eg. 2 bit 0b11 -> 0xFF)
+    uint8_t scale = bd < 8 ? 255 / ((1 << bd) - 1) : 1;
+    uint8_t shift = bd == 16 ? 8 : 0;
+    uint8_t channels = ctx.channels;
+    bool color = channels >= 3;
+    bool alpha = channels == 2 || channels == 4;
+    for(uint32_t x = 0; x < width; x++, out += 3)
+    {
+      uint16_t s[4];
+      for(uint32_t c = 0; c < channels; c++)
+        s[c] = read_sample(row, x * channels + c, bd);
+
+      uint8_t rgb[3];
+      uint8_t a = 0xFF;
+      for(uint32_t c = 0; c < 3; c++)
+        rgb[c] = (s[color ? c : 0] >> shift) * scale;
+      if(alpha) a = s[channels - 1] >> shift;
+      else if(ctx.trns_key_valid && s[0] == ctx.trns_key[0] && (!color || (s[1] == ctx.trns_key[1] && s[2] == ctx.trns_key[2]))) a = 0;
+
+      if(a == 0xFF) memcpy(out, rgb, 3);
+      else
+      {
+        if(a == 0 && mask) set_mask_bit(mask, mask_bit + x);
+        const uint8_t* under = backdrop ? backdrop + 3 * x : bg;
+        for(uint32_t c = 0; c < 3; c++)
+          out[c] = blend(rgb[c], a, under[c]);
+      }
+    }
+    return true;
+  }
+
+  bool parse_rgb(png_parse_context_s& ctx, uint8_t* output, uint32_t output_size)
+  {
+    if(output == NULL) return false;
+    ctx.output = output;
+    ctx.output_size = output_size;
+    bool ok = parse_rows(ctx, rgb_row, &ctx);
+
+    //the composited palette is only needed while decoding
+    if(ctx.output_palette) free(ctx.output_palette);
+    ctx.output_palette = NULL;
+    return ok;
+  }
+
+  bool parse_next_frame(png_parse_context_s& ctx, uint8_t* output, uint32_t output_size, uint8_t* mask, const uint8_t* backdrop)
+  {
+    if(output == NULL) return false;
+    if(!ctx.animated || ctx.frame_index >= ctx.num_frames) return false;
+    ctx.output = output;
+    ctx.output_size = output_size;
+    ctx.sink = rgb_row;
+    ctx.sink_user = &ctx;
+
+    //find the next frame control and its image data, the default image is the first frame only if a frame control precedes it
+    bool ok = false;
+    chunk_data_s cd;
+    while(check_next_chunk(ctx, cd)) //does crc check too
+    {
+      if(cd.type == chunk_type_iend) break;
+      if(cd.type == chunk_type_fctl)
+      {
+        if(!parse_fctl(ctx)) break;
+        continue;
+      }
+
+      //other chunks and the rest of the previous frame's image data are skipped
+      bool frame_data = ctx.fctl_pending && (cd.type == chunk_type_fdat || (cd.type == chunk_type_idat && ctx.frame_index == 0));
+      if(!frame_data)
+      {
+        ctx.offset += cd.len + 4 + 4 + 4; //skip entire chunk (len, type, data, crc32)
+        continue;
+      }
+
+      //the default image can't be a partial frame
+      if(cd.type == chunk_type_idat && (ctx.fctl.width != ctx.hdr.width || ctx.fctl.height != ctx.hdr.height || ctx.fctl.x_offset != 0 || ctx.fctl.y_offset != 0)) break;
+
+      //the mask has a bit for every pixel of the region, transparent pixels of blended frames are kept from the previous frame
+      if((uint64_t)ctx.fctl.width * ctx.fctl.height * 3 > output_size) break; //output too small
+      //semi-transparent pixels of blended frames are composited over what's under them
+      ctx.output_mask = ctx.fctl.blend_op == blend_op_over ? mask : NULL;
+      ctx.output_backdrop = ctx.fctl.blend_op == blend_op_over ? backdrop : NULL;
+      if(ctx.output_mask) memset(ctx.output_mask, 0, (ctx.fctl.width * ctx.fctl.height + 7) / 8);
+      ctx.fctl_pending = false;
+      ok = decode_image_data(ctx, cd.type);
+      break;
+    }
+
+    //the composited palette is kept for the next frames
+    ctx.output_mask = NULL;
+    ctx.output_backdrop = NULL;
+    if(ok) ctx.frame_index++;
+    return ok;
+  }
+
+  bool rewind_frames(png_parse_context_s& ctx)
+  {
+    if(!ctx.animated || ctx.data == NULL) return false;
+    ctx.offset = ctx.frames_offset;
+    ctx.frame_index = 0;
+    ctx.fctl_pending = false;
+    return true;
+  }
+
+  uint32_t read_be32(const uint8_t* p)
+  {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+  }
+
+  void validator_init(png_validator_s& v)
+  {
+    memset(&v, 0, sizeof(v));
+    v.part = validator_part_signature;
+    v.valid = true;
+  }
+
+  void validator_feed(png_validator_s& v, const uint8_t* data, uint32_t len)
+  {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
+
+    while(len && v.valid)
+    {
+      //trailing bytes after IEND are ignored, like by the parser
+      if(v.part == validator_part_end) return;
+
+      //chunk data only goes through the CRC
+      if(v.part == validator_part_data)
+      {
+        uint32_t n = len < v.left ? len : v.left;
+        v.crc = tinf_crc32_update(v.crc, data, n);
+        data += n;
+        len -= n;
+        v.left -= n;
+        if(v.left == 0) v.part = validator_part_crc;
+        continue;
+      }
+
+      //the other parts are collected whole, they can be split between the fed parts
+      uint8_t size = v.part == validator_part_crc ? 4 : 8;
+      uint32_t n = size - v.buffered;
+      if(n > len) n = len;
+      memcpy(v.buffer + v.buffered, data, n);
+      v.buffered += n;
+      data += n;
+      len -= n;
+      if(v.buffered < size) return;
+      v.buffered = 0;
+
+      switch (v.part)
+      {
+      case validator_part_signature:
+      {
+        v.valid = memcmp(v.buffer, signature, 8) == 0;
+        v.part = validator_part_header;
+        break;
+      }
+      case validator_part_header:
+      {
+        //the first chunk must be the header, chunk lengths are limited to 2^31 - 1 by the standard
+        uint32_t chunk_len = read_be32(v.buffer);
+        bool first = v.type == 0;
+        v.type = read_be32(v.buffer + 4);
+        if(chunk_len > 0x7FFFFFFF || (first && v.type != chunk_type_ihdr)) v.valid = false;
+        v.crc = tinf_crc32_update(0, v.buffer + 4, 4);
+        v.left = chunk_len;
+        v.part = chunk_len ? validator_part_data : validator_part_crc;
+        break;
+      }
+      case validator_part_crc:
+      {
+        v.valid = read_be32(v.buffer) == v.crc;
+        v.part = v.type == chunk_type_iend ? validator_part_end : validator_part_header;
+        break;
+      }
+      default:
+        break;
+      }
+    }
+  }
+
+  bool validator_finish(png_validator_s& v)
+  {
+    return v.valid && v.part == validator_part_end;
+  }
 }
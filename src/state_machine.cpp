@@ -3,15 +3,14 @@
 #include <FastLED.h>
 
 #include "web.hpp"
-#include "gif_parse.hpp"
-#include "png_parse.hpp"
+#include "decoder.hpp"
+#include "image_cache.hpp"
 
 namespace pixelbox
 {
   namespace state_machine
   {
     extern CRGB connecting_image[];        //image displayed on startup/during connecting to Wi-Fi
-    pixelbox::anim::animation_s animation; //animation data, for displaying GIF files
 
     void click_cb() //on click let's display the next stored image from flash
     { 
@@ -20,110 +19,76 @@ namespace pixelbox
       pixelbox::web::select_next_image(act);
     }
 
-    void image_updated() //on image updated try to parse and display image
+    CRGB frame[WS_LED_NUM];                    //decoders write the pixels of animation frames here
+    uint8_t frame_mask[(WS_LED_NUM + 7) / 8];  //and the transparency mask here
+
+    //the renderer is the destination of every decoder
+    const pixelbox::decoder::sink_s display_sink = {
+      WS_LED_WIDTH, WS_LED_HEIGHT, frame, frame_mask,
+      pixelbox::ws2812b_8x8::begin_image, pixelbox::ws2812b_8x8::show_image,
+      pixelbox::ws2812b_8x8::set, pixelbox::ws2812b_8x8::set, true, pixelbox::ws2812b_8x8::loop
+    };
+
+    volatile bool image_pending = false; //the displayed image changed, loop loads it
+
+    static void transcode(const String& filename, pixelbox::web::image_meta_s& meta) //decode an uploaded image once into its native container, displaying it later only reads that
+    {
+      File image_file = LittleFS.open("/images/" + filename, "r");
+      File native_file = LittleFS.open("/native/" + filename, "w");
+      meta.native = image_file && native_file && pixelbox::decoder::transcode(filename, image_file, native_file, WS_LED_WIDTH, WS_LED_HEIGHT);
+      if(native_file) native_file.close(); //the decoder closes the image file
+      if(!meta.native) LittleFS.remove("/native/" + filename); //the original is decoded when displayed
+      meta.transcode_pending = false;
+      pixelbox::web::set_image_meta(filename, meta);
+    }
+
+    static void load_image() //parse and display the displayed image
     {
+      //stop decoding the previous image if it was played frame by frame
+      pixelbox::decoder::stop();
+
       //read the displayed image's name and open it
       String filename;
       if(!pixelbox::web::get_displayed_image(filename)) return;
       File image_file = LittleFS.open("/images/" + filename, "r");
       if(!image_file) return;
 
-      //currently only supports PNG and GIF, check the file extension
-      bool png = true;
-      if(filename.endsWith(".png")) png = true;
-      else if(filename.endsWith(".gif")) png = false;
-      else return;
-
-      //read image file into RAM
-      uint32_t img_size = image_file.size();
-      uint8_t* img_buf = (uint8_t*) malloc(img_size);
-      if(img_buf == NULL) return;
-      if((size_t)image_file.read((uint8_t*)img_buf, img_size) != img_size)
+      //recently shown images are copied from the cache instead of decoded
+      uint32_t version = image_file.size();
+      if(pixelbox::image_cache::show(filename, version, &display_sink))
       {
-        free(img_buf);
         image_file.close();
         return;
       }
-      image_file.close(); //we don't need the file to be open any more, close it
-
-      //temporary buffer for image data to be displayed
-      CRGB image[WS_LED_NUM];
-
-      if(png)
+      pixelbox::image_cache::trim();
+      const pixelbox::decoder::sink_s* sink = pixelbox::image_cache::recording_sink(filename, version, &display_sink);
+
+      //images transcoded after upload are loaded from their native container, unless the original changed since (the original is decoded if it fails)
+      //a freshly uploaded image is transcoded first, the upload callback left it to here
+      pixelbox::web::image_meta_s meta;
+      bool meta_valid = pixelbox::web::get_image_meta(filename, meta) && meta.size == version;
+      if(meta_valid && meta.transcode_pending) transcode(filename, meta);
+      if(meta_valid && meta.native)
       {
-        //init the PNG parsing context
-        img_parse::png_parse_context_s ctx;
-        if(!img_parse::init(ctx, img_buf, img_size)) return;
-        free(img_buf); //after init, image data copied into the ctx, no need for the img_buf (can be optimized if we read the image data from flash right into the context)
-
-        //parse and check for error OR image with invalid size
-        if(!img_parse::parse(ctx) || (ctx.hdr.height != 8 || ctx.hdr.width != 8))
+        File native_file = LittleFS.open("/native/" + filename, "r");
+        if(native_file && pixelbox::decoder::decode(filename, native_file, sink))
         {
-          img_parse::deinit(ctx);
-          pixelbox::ws2812b_8x8::set_color(CRGB::Red); //display red color for error
+          image_file.close();
           return;
         }
-
-        //export output pixel data from the context into the CRGB array to pass it to fastled
-        if(ctx.pixel_size == 3)
-          memcpy(image, ctx.unfiltered_data, sizeof(image));
-        else if(ctx.pixel_size == 4)
-        {
-          for(u8 i = 0; i < WS_LED_NUM; i++)
-          {
-            image[i].r = ctx.unfiltered_data[4*i+0];
-            image[i].g = ctx.unfiltered_data[4*i+1];
-            image[i].b = ctx.unfiltered_data[4*i+2];
-          }
-        }
-
-        //dealloc everything left from the parsing
-        img_parse::deinit(ctx);
-
-        //set the image to be displayed
-        pixelbox::ws2812b_8x8::set(image);
       }
-      else
-      {
-        //init the GIF parsing context
-        img_parse::gif_parse_context_s ctx;        
-        if(img_parse::init(ctx, img_buf, img_size) != img_parse::error_code_ok) return;
-        free(img_buf); //after init, image data copied into the ctx, no need for the img_buf (can be optimized if we read the image data from flash right into the context)
-        
-        //parse and check for error OR image with invalid size
-        if(img_parse::parse(ctx) != img_parse::error_code_ok || (ctx.lsd.height != 8 || ctx.lsd.width != 8))
-        {
-          img_parse::deinit(ctx);
-          pixelbox::ws2812b_8x8::set_color(CRGB::Red); //display red color for error
-          return;
-        }
 
-        if(ctx.images_size == 1) //if it's an image, simply set it
-        {
-          memcpy(image, ctx.images[0].output, sizeof(image));
-          pixelbox::ws2812b_8x8::set(image);
-        }
-        else //if it's an animation export the frames into an animation and set it
-        {
-          pixelbox::anim::animation_init(&animation); //dealloc if necessary and zero everything
-          for(uint32_t i = 0; i < ctx.images_size; i++)
-          {
-            if(!ctx.images[i].gce.valid) continue; //skip frames without gce
-            pixelbox::anim::add_frame(&animation, 
-                            ctx.images[i].gce.delay_time_10ms * 10, 
-                            ctx.images[i].id.left_position, 
-                            ctx.images[i].id.top_position,
-                            (CRGB*)ctx.images[i].output,
-                            ctx.images[i].output_size);
-          }
-          pixelbox::ws2812b_8x8::set(&animation);
-        }
+      //the decoder is chosen by the content of the file and draws straight into the renderer
+      if(!pixelbox::decoder::decode(filename, image_file, sink))
+        pixelbox::ws2812b_8x8::set_color(CRGB::Red); //display red color for error
+    }
 
-        //dealloc everything left from the parsing
-        img_parse::deinit(ctx);
-      }
+    void image_updated() //on image updated the image is parsed and displayed by loop, the web server calls this from its callbacks where decoding would stall it
+    {
+      image_pending = true;
     }
 
+
     void load_brightness()
     {
       File f = LittleFS.open("/brightness", "r");
@@ -158,9 +123,17 @@ namespace pixelbox
     {
       //on startup set the connecting image if no image is uploaded/storage is empty
       pixelbox::ws2812b_8x8::set(connecting_image);
-      image_updated();
+      load_image();
       load_max_current();
       load_brightness();
     }
+
+    void loop()
+    {
+      //the slow work the callbacks asked for (transcoding, decoding) is done here, between renders
+      if(!image_pending) return;
+      image_pending = false;
+      load_image();
+    }
   }  
 }
@@ -4,6 +4,8 @@
 #include <LittleFS.h>
 
 #include "ws2812b_8x8.hpp"
+#include "png_parse.hpp"
+#include "image_cache.hpp"
 
 namespace pixelbox
 {
@@ -65,6 +67,24 @@ namespace pixelbox
       }
     }
 
+    bool get_image_meta(String name, image_meta_s& meta)
+    {
+      File mf = LittleFS.open("/meta/" + name, "r");
+      if(!mf) return false;
+      bool ok = mf.read((uint8_t*)&meta, sizeof(meta)) == sizeof(meta);
+      mf.close();
+      return ok;
+    }
+
+    bool set_image_meta(String name, const image_meta_s& meta)
+    {
+      File mf = LittleFS.open("/meta/" + name, "w");
+      if(!mf) return false;
+      bool ok = mf.write((const uint8_t*)&meta, sizeof(meta)) == sizeof(meta);
+      mf.close();
+      return ok;
+    }
+
     bool del_image(String name)
     {
       String displayed_image;
@@ -73,6 +93,9 @@ namespace pixelbox
       //if we want to delete the displayed image, we will set the next one as displayed
       if(name == displayed_image) select_next_image(displayed_image);
 
+      LittleFS.remove("/meta/" + name);
+      LittleFS.remove("/native/" + name);
+      pixelbox::image_cache::invalidate(name);
       return LittleFS.remove("/images/" + name);
     }
 
@@ -85,12 +108,24 @@ namespace pixelbox
     {
       if(index == 0)
       {
+        //the metadata, the native container and the cached decoding of a replaced image are not valid any more
+        LittleFS.remove("/meta/" + filename);
+        LittleFS.remove("/native/" + filename);
+        pixelbox::image_cache::invalidate(filename);
+
         request->_tempFile = LittleFS.open("/images/" + filename, "w");
         if(!request->_tempFile)
         {
           request->send(500, "plain/text", "Failed to open file.");
           return;
         }
+
+        //PNGs are validated while they are received, the request frees the validator
+        if(filename.endsWith(".png"))
+        {
+          request->_tempObject = malloc(sizeof(img_parse::png_validator_s));
+          if(request->_tempObject) img_parse::validator_init(*(img_parse::png_validator_s*)request->_tempObject);
+        }
       }
 
       request->_tempFile.seek(index);
@@ -100,11 +135,18 @@ namespace pixelbox
         request->send(500, "plain/text", "Write error.");
         return;
       }
+      img_parse::png_validator_s* validator = (img_parse::png_validator_s*)request->_tempObject;
+      if(validator) img_parse::validator_feed(*validator, data, len);
 
       if (final)
       {
         request->_tempFile.close();
 
+        //record the validation, so loading the image doesn't have to check it again (transcoding reads it too)
+        //the image is transcoded into the native container by the main loop, decoding in this callback would stall the web server
+        image_meta_s meta = {(uint32_t)(index + len), validator && img_parse::validator_finish(*validator), false, true};
+        set_image_meta(filename, meta);
+
         if(!set_displayed_image(filename))
         {
           request->send(500, "plain/text", "Set error.");
@@ -237,6 +279,15 @@ namespace pixelbox
         output += "{\"total_size\":" + processor("TOTAL_SIZE") + ", \"allocated_size\":" + processor("ALLOCATED_SIZE") + ", \"free_heap\":" + processor("FREE_HEAP") + "}";
         request->send(200, "text/json", output);
       });
+      server.on("/render_stats", HTTP_GET, [](AsyncWebServerRequest* request)
+      {
+        const pixelbox::ws2812b_8x8::render_stats_s* stats = pixelbox::ws2812b_8x8::get_render_stats();
+        String output;
+        output += "{\"frames\":" + String(stats->frames) + ", \"coalesced\":" + String(stats->coalesced) + ", \"resyncs\":" + String(stats->resyncs);
+        output += ", \"late_max_us\":" + String(stats->late_max_us) + ", \"late_mean_us\":" + String(stats->frames ? stats->late_sum_us / stats->frames : 0);
+        output += ", \"jitter_us\":" + String(stats->jitter_us) + ", \"played_ms\":" + String(stats->played_ms) + ", \"elapsed_ms\":" + String(stats->elapsed_ms) + "}";
+        request->send(200, "text/json", output);
+      });
       server.on("/set_brightness", HTTP_POST, [](AsyncWebServerRequest* request)
       {
         File br = LittleFS.open("/brightness", "w");
@@ -1,118 +1,465 @@
 #include "ws2812b_8x8.hpp"
 
 #include <FastLED.h>
-#include <arduino-timer.h>
 #include "anim.hpp"
+#include "color.hpp"
+#include "decoder.hpp"
 #include "Hash.h"
 
 namespace pixelbox
 {
   namespace ws2812b_8x8
   {
-    CRGB out[WS_LED_NUM];             //framebuffer, FastLED will display this
+    CRGB canvas[WS_LED_NUM];          //framebuffer, images and animation frames are composited here
+    CRGB out[WS_LED_NUM];             //the canvas through the color pipeline, FastLED will display this
     bool on = true;                   //enable/disable display
-    anim::animation_s* anim = NULL;   //pointer of animation to be displayed
+    anim::animation_s animation;      //animation to be displayed, owned by the renderer (its slab is moved in by set)
+    anim::frame_source_s* source = NULL; //pointer of frame source to be displayed (animation decoded during playback)
 
-    Timer timer = Timer<1, millis>(); //ms timer for rendering
+    //frames are scheduled at absolute deadlines on the micros() timeline, every deadline follows the previous one by the frame delay, so a late tick doesn't delay the later frames
+    uint32_t deadline = 0;            //micros when the next frame has to be on the LEDs
+    uint32_t show_us = 0;             //duration of the last show, frames are started earlier by this
+    render_stats_s stats;             //timing of the played animation
+    uint32_t stats_start = 0;         //millis of the first frame of the played animation
+    int32_t last_late_us = 0;         //lateness of the previous frame, for the jitter
+
+    //the LEDs are only written when their output would change, a show blocks the interrupts for ~2 ms
+    CRGB shown[WS_LED_NUM];           //output at the last show
+    bool dirty = true;                //output parameters outside of the color pipeline (power limit) changed since the last show
+    uint32_t last_show = 0;           //millis of the last show
+
+    //current limiting, the output is scaled by FastLED's brightness when the canvas would draw more than max_current_ma
+    uint32_t max_current_ma = 0;      //0 is unlimited
+    uint32_t canvas_light[3];         //linear light of the canvas (see color::light), the current draw at any brightness is derived from it
+    bool canvas_light_valid = false;  //canvas_light belongs to the canvas, otherwise it's measured at the next show
+
+    //transitions between contents, the outgoing frame is blended into the incoming content at the render rate
+    uint8_t transition_pattern = WS_TRANSITION_PATTERN; //transition_e
+    uint32_t transition_ms = WS_TRANSITION_MS;
+    bool transitioning = false;
+    uint32_t transition_start = 0;    //micros of the content switch
+    uint32_t transition_tick = 0;     //micros of the next transition step
+    CRGB from[WS_LED_NUM];            //outgoing frame
+    CRGB mixed[WS_LED_NUM];           //blend of the outgoing frame and the canvas, shown during a transition
+    CRGB incoming[WS_LED_NUM];        //still images are decoded here, the outgoing frame stays in the canvas meanwhile
+
+    //compositing state of partial animation frames
+    anim::frame_s last_frame;         //rectangle and disposal method of the last drawn frame
+    CRGB before_last_frame[WS_LED_NUM]; //framebuffer before the last frame was drawn (for disposal_previous)
 
     //locally used funcs
-    bool render(void* data);
+    void render();
+    void show();
+    uint8_t current_cap();
+    void begin_transition();
+    void mix_transition();
+    void idle();
+    void start_playback();
+    void schedule(uint32_t delay_ms);
     void render_next_anim_frame();
+    void render_next_source_frame();
+    void prefetch_source_frame();
+    void reset_canvas();
+    void draw_frame(const anim::frame_s* frame);
 
     void set(CRGB *in)
     {
       if(in == NULL) return;
-      ws2812b_8x8::anim = NULL;
-      timer.cancel();
-      timer.every(33, render);
-      memcpy(out, in, WS_LED_NUM * 3);
-      FastLED.show();
+      anim::animation_init(&animation);
+      ws2812b_8x8::source = NULL;
+      idle();
+      begin_transition();
+      memcpy(canvas, in, WS_LED_NUM * 3);
+      canvas_light_valid = false;
+      show();
     }
 
     void set(anim::animation_s* anim)
     {
-      ws2812b_8x8::anim = anim;
+      anim::animation_move(&animation, anim); //frees the previous animation
+      ws2812b_8x8::source = NULL;
+      begin_transition();
+      reset_canvas();
+      start_playback();
       render_next_anim_frame();
-      FastLED.show();
+      show();
+    }
+
+    void set(anim::frame_source_s* source)
+    {
+      anim::animation_init(&animation);
+      ws2812b_8x8::source = source;
+      begin_transition();
+      reset_canvas();
+      start_playback();
+      render_next_anim_frame();
+      show();
+      prefetch_source_frame();
     }
 
     void set_color(CRGB color)
     {
-      ws2812b_8x8::anim = NULL;
-      timer.cancel();
-      timer.every(33, render);
-      fill_solid(out, WS_LED_NUM, color);
-      FastLED.show();
+      anim::animation_init(&animation);
+      ws2812b_8x8::source = NULL;
+      idle();
+      begin_transition();
+      fill_solid(canvas, WS_LED_NUM, color);
+      canvas_light_valid = false;
+      show();
+    }
+
+    CRGB* begin_image()
+    {
+      //images are decoded into a buffer of the renderer instead of copied by set, the last frame of the stopped content stays displayed meanwhile
+      anim::animation_init(&animation);
+      ws2812b_8x8::source = NULL;
+      idle();
+      return incoming;
+    }
+
+    void show_image()
+    {
+      begin_transition();
+      memcpy(canvas, incoming, sizeof(canvas));
+      canvas_light_valid = false;
+      show();
+    }
+
+    void set_transition(uint8_t pattern, uint32_t duration_ms)
+    {
+      if(duration_ms > WS_MAX_TRANSITION_MS) duration_ms = WS_MAX_TRANSITION_MS;
+      transition_pattern = pattern;
+      transition_ms = duration_ms;
     }
 
     void set_brightness(uint8_t value)
     {
-      FastLED.setBrightness(value);
+      color::set_brightness(value); //shown at the next render
     }
 
     void set_brightness_percent(uint8_t percent)
     {
       if(percent > 100) percent = 100;
-      FastLED.setBrightness(percent * 255 / 100);
+      set_brightness(percent * 255 / 100);
+    }
+
+    void set_color_correction(CRGB correction)
+    {
+      color::set_correction(correction);
+    }
+
+    void set_dither(bool on)
+    {
+      color::set_dither(on);
     }
 
     void set_max_current(uint32 current_ma)
     {
       if(current_ma > 3000) current_ma = 3000;
-      FastLED.setMaxPowerInVoltsAndMilliamps(5, current_ma);
+      max_current_ma = current_ma;
+      dirty = true; //the cap is derived again at the next show
+    }
+
+    uint8_t current_cap()
+    {
+      //integer model of the WS2812B current (same as FastLED's power management), a channel draws in proportion to its output level
+      if(!max_current_ma) return 255;
+      uint32_t mixed_light[3];
+      const uint32_t* light = canvas_light;
+      if(transitioning)
+      {
+        //the blend is different at every step
+        color::light(mixed, WS_LED_NUM, mixed_light);
+        light = mixed_light;
+      }
+      else if(!canvas_light_valid)
+      {
+        color::light(canvas, WS_LED_NUM, canvas_light);
+        canvas_light_valid = true;
+      }
+
+      //lit current in 1/255 mA: linear light * calibration * brightness * full level current
+      CRGB correction = color::get_correction();
+      uint64_t lit = ((uint64_t)light[0] * correction.r * WS_RED_MA +
+                      (uint64_t)light[1] * correction.g * WS_GREEN_MA +
+                      (uint64_t)light[2] * correction.b * WS_BLUE_MA) * color::get_brightness() / (255 * 255);
+      uint32_t dark = WS_LED_NUM * WS_DARK_MA;
+      if(max_current_ma <= dark) return 0;
+      uint64_t budget = (uint64_t)(max_current_ma - dark) * 255;
+      return lit <= budget ? 255 : budget * 255 / lit;
     }
 
     void set_enable(bool on)
     {
-      ws2812b_8x8::on = on;
       if(!on)
       {
-        ws2812b_8x8::anim = NULL;
-        fill_solid(out, WS_LED_NUM, CRGB::Black);
-        FastLED.show();
+        //the LEDs are switched off and nothing is rendered until enabled again
+        //a source played frame by frame is stopped first, so its decoder releases the file and buffers it reads from
+        decoder::stop();
+        anim::animation_init(&animation);
+        ws2812b_8x8::source = NULL;
+        transitioning = false;
+        fill_solid(canvas, WS_LED_NUM, CRGB::Black);
+        canvas_light_valid = false;
+        dirty = true;
+        show();
+      }
+      else if(!ws2812b_8x8::on)
+      {
+        deadline = micros();
+        dirty = true;
+      }
+      ws2812b_8x8::on = on;
+    }
+
+    void show()
+    {
+      //the LEDs keep the last shown data, unchanged frames are skipped (and sent again rarely, in case of a glitch)
+      if(!on) return;
+      if(transitioning) mix_transition();
+      color::apply(transitioning ? mixed : canvas, out, WS_LED_NUM);
+      bool refresh = WS_REFRESH_INTERVAL && millis() - last_show >= WS_REFRESH_INTERVAL;
+      if(!dirty && !refresh && memcmp(shown, out, sizeof(out)) == 0) return;
+      FastLED.setBrightness(current_cap());
+      uint32_t start = micros();
+      FastLED.show();
+      show_us = micros() - start;
+      memcpy(shown, out, sizeof(out));
+      dirty = false;
+      last_show = millis();
+    }
+
+    void begin_transition()
+    {
+      //the outgoing frame is what's displayed now, the blend if a transition is still running
+      if(!transition_ms || transition_pattern == transition_cut)
+      {
+        transitioning = false;
+        return;
+      }
+      memcpy(from, transitioning ? mixed : canvas, sizeof(from));
+      transitioning = true;
+      transition_start = micros();
+      transition_tick = transition_start;
+    }
+
+    static uint32_t transition_alpha(uint32_t i, uint32_t t) //share of the incoming content in the pixel at progress t, both 0..256
+    {
+      if(transition_pattern == transition_fade) return t;
+
+      //wipes sweep a soft edge over the pixels' keys, from before the first key to after the last one
+      uint32_t x = i % WS_LED_WIDTH, y = i / WS_LED_WIDTH, key;
+      switch (transition_pattern)
+      {
+      case transition_wipe_right: key = x * 255 / (WS_LED_WIDTH - 1); break;
+      case transition_wipe_down: key = y * 255 / (WS_LED_HEIGHT - 1); break;
+      case transition_wipe_diagonal: key = (x + y) * 255 / (WS_LED_WIDTH + WS_LED_HEIGHT - 2); break;
+      default: key = (i * 167 + 13) & 0xFF; break; //dissolve, an odd multiplier scatters the pixels over the keys
       }
+      int32_t edge = (int32_t)(t * (256 + WS_WIPE_EDGE) >> 8) - (int32_t)key;
+      if(edge <= 0) return 0;
+      if(edge >= WS_WIPE_EDGE) return 256;
+      return edge * 256 / WS_WIPE_EDGE;
+    }
+
+    void mix_transition()
+    {
+      uint32_t elapsed = micros() - transition_start;
+      if(elapsed >= transition_ms * 1000)
+      {
+        transitioning = false;
+        return;
+      }
+
+      //fixed point blend, the canvas keeps playing under it
+      uint32_t t = elapsed * 256 / (transition_ms * 1000);
+      for(uint32_t i = 0; i < WS_LED_NUM; i++)
+      {
+        uint32_t a = transition_alpha(i, t);
+        mixed[i].r = (from[i].r * (256 - a) + canvas[i].r * a) >> 8;
+        mixed[i].g = (from[i].g * (256 - a) + canvas[i].g * a) >> 8;
+        mixed[i].b = (from[i].b * (256 - a) + canvas[i].b * a) >> 8;
+      }
+    }
+
+    void reset_canvas()
+    {
+      //animations are composited onto a black canvas
+      fill_solid(canvas, WS_LED_NUM, CRGB::Black);
+      memset(&last_frame, 0, sizeof(last_frame));
+      canvas_light_valid = false;
+    }
+
+    void draw_frame(const anim::frame_s* frame)
+    {
+      //dispose the last frame's rectangle
+      if(last_frame.disposal == anim::disposal_background)
+        anim::fill_rect(canvas, WS_LED_WIDTH, WS_LED_HEIGHT, last_frame.x, last_frame.y, last_frame.width, last_frame.height, CRGB::Black);
+      else if(last_frame.disposal == anim::disposal_previous)
+        anim::copy_rect(canvas, before_last_frame, WS_LED_WIDTH, WS_LED_HEIGHT, last_frame.x, last_frame.y, last_frame.width, last_frame.height);
+
+      //save the area which will be restored after this frame
+      if(frame->disposal == anim::disposal_previous)
+        anim::copy_rect(before_last_frame, canvas, WS_LED_WIDTH, WS_LED_HEIGHT, frame->x, frame->y, frame->width, frame->height);
+
+      anim::blit(frame, canvas, WS_LED_WIDTH, WS_LED_HEIGHT);
+      last_frame = *frame;
+
+      //delta frames know the current draw of the canvas after them
+      canvas_light_valid = frame->light_valid;
+      if(canvas_light_valid) memcpy(canvas_light, frame->light, sizeof(canvas_light));
+    }
+
+    void render_next_source_frame()
+    {
+      //ask the source to decode the next frame
+      anim::frame_s frame;
+      if(!source->next_frame(source->user, &frame))
+      {
+        //no more frames (still image or decoding error), keep the last one displayed
+        source = NULL;
+        idle();
+        return;
+      }
+
+      //deadline of the next frame transition
+      schedule(frame.delay_ms);
+
+      //composite the frame onto the frambuffer (clipped)
+      draw_frame(&frame);
+    }
+
+    void prefetch_source_frame()
+    {
+      //the source reads ahead while the shown frame is displayed, so the next show isn't delayed by it
+      if(source && source->prefetch) source->prefetch(source->user);
     }
 
     void render_next_anim_frame()
     {
-      if(!anim) return;
+      if(source)
+      {
+        render_next_source_frame();
+        return;
+      }
+      if(!animation.frames_size) return;
 
       //loop the animation if reached the end
-      if(anim->frame_index >= anim->frames_size) anim->frame_index = 0;
+      if(animation.frame_index >= animation.frames_size) animation.frame_index = 0;
 
-      //set the timer at the next frame transition
-      timer.cancel();
-      timer.every(anim->frames[anim->frame_index].delay_ms, render);
+      //deadline of the next frame transition
+      schedule(animation.frames[animation.frame_index].delay_ms);
       
-      //overcopy protection & copy pixel data to the frambuffer
-      uint16_t pixels_to_copy = anim->frames[anim->frame_index].pixels_size;
-      if(pixels_to_copy > WS_LED_NUM) pixels_to_copy = WS_LED_NUM;
-      memcpy(out, anim->frames[anim->frame_index].pixels, pixels_to_copy * 3);
+      //composite the frame onto the frambuffer (clipped)
+      draw_frame(&animation.frames[animation.frame_index]);
 
       //increment the frame index for next iteration
-      anim->frame_index++;
+      animation.frame_index++;
     }
 
-    bool render(void* data)
+    void idle()
     {
-      render_next_anim_frame(); //returns immediately if no animation is set
-      FastLED.show();
-      return true;
+      //still content is only rendered for brightness changes and the refresh
+      deadline = micros() + WS_IDLE_INTERVAL * 1000;
+    }
+
+    void start_playback()
+    {
+      //the first frame is due now, the timeline and the statistics start with it
+      deadline = micros();
+      memset(&stats, 0, sizeof(stats));
+      stats_start = millis();
+      last_late_us = 0;
+    }
+
+    void schedule(uint32_t delay_ms)
+    {
+      //pathological delays (GIFs without delay) would redraw on every loop, they are clamped like in browsers
+      if(delay_ms <= WS_MIN_FRAME_DELAY) delay_ms = WS_DEFAULT_FRAME_DELAY;
+      //the lateness is signed 32 bit us, a deadline over ~35 minutes ahead would look late (and the us overflow after ~71 minutes)
+      if(delay_ms > WS_MAX_FRAME_DELAY) delay_ms = WS_MAX_FRAME_DELAY;
+      deadline += delay_ms * 1000;
+      stats.played_ms += delay_ms;
+    }
+
+    bool playing()
+    {
+      return source || animation.frames_size;
+    }
+
+    void render()
+    {
+      if(!playing())
+      {
+        idle();
+        show();
+        return;
+      }
+
+      //lateness of the frame and its change since the previous frame (smoothed, like the RTP interarrival jitter)
+      int32_t late_us = (int32_t)(micros() + show_us - deadline);
+      int32_t late_change = late_us - last_late_us;
+      if(late_us > 0 && (uint32_t)late_us > stats.late_max_us) stats.late_max_us = late_us;
+      if(late_us > 0) stats.late_sum_us += late_us;
+      stats.jitter_us += ((late_change < 0 ? -late_change : late_change) - (int32_t)stats.jitter_us) / 16;
+      last_late_us = late_us;
+      stats.frames++;
+      render_next_anim_frame();
+
+      //fallen behind, the frames already due are composited without being shown, the playback catches up instead of drifting later
+      uint32_t coalesced = 0;
+      while(playing() && (int32_t)(micros() + show_us - deadline) >= 0)
+      {
+        if(coalesced == WS_MAX_COALESCED_FRAMES)
+        {
+          //too far behind (eg. flash writes), the timeline restarts from now
+          deadline = micros();
+          stats.resyncs++;
+          break;
+        }
+        render_next_anim_frame();
+        coalesced++;
+        stats.coalesced++;
+      }
+
+      show();
+      prefetch_source_frame();
+    }
+
+    const render_stats_s* get_render_stats()
+    {
+      stats.elapsed_ms = stats.played_ms ? millis() - stats_start : 0;
+      return &stats;
     }
 
     void setup()
     {
       FastLED.addLeds<WS2812B, WS_DATA_PIN, GRB>(out, WS_LED_NUM);
-      FastLED.setBrightness(64);
-      fill_solid(out, WS_LED_NUM, CHSV(0,0,0));
-      FastLED.show();
-      timer.every(33, render); //set the render timer @30 FPS
-      anim = NULL;
+      FastLED.setBrightness(255); //brightness is in the color tables, FastLED's scales the output for current limiting only
+      FastLED.setDither(DISABLE_DITHER);
+      color::set_brightness(64);
+      fill_solid(canvas, WS_LED_NUM, CHSV(0,0,0));
+      dirty = true;
+      show();
+      idle();
+      anim::animation_init(&animation);
+      source = NULL;
     }
 
     void loop()
     {
-      timer.tick();
+      if(!on) return;
+
+      //transitions are rendered at their own rate, the frames of the content may be far apart
+      if(transitioning && (int32_t)(micros() - transition_tick) >= 0)
+      {
+        transition_tick = micros() + WS_TRANSITION_INTERVAL * 1000;
+        show();
+      }
+
+      //the frame is started earlier by the duration of a show, so it's on the LEDs by its deadline
+      if((int32_t)(micros() + show_us - deadline) < 0) return;
+      render();
     }
   };
 };
\ No newline at end of file
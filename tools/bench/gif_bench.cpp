@@ -0,0 +1,65 @@
+//host benchmark of the GIF decoder: allocations and time per img_parse::parse of whole GIF files given as arguments (make_gif_corpus.py)
+//malloc, calloc and realloc are counted through the linker's --wrap, built from the original gif_parse.cpp it measures the per code string table
+
+#include "gif_parse.hpp"
+
+#include <cstdio>
+#include <vector>
+#include <chrono>
+
+#define BENCH_RUNS 2000
+#define BENCH_MAX_SIZE (1 << 20)
+
+extern "C"
+{
+  void* __real_malloc(size_t size);
+  void* __real_calloc(size_t count, size_t size);
+  void* __real_realloc(void* ptr, size_t size);
+
+  static uint64_t allocs = 0;
+  void* __wrap_malloc(size_t size) { allocs++; return __real_malloc(size); }
+  void* __wrap_calloc(size_t count, size_t size) { allocs++; return __real_calloc(count, size); }
+  void* __wrap_realloc(void* ptr, size_t size) { allocs++; return __real_realloc(ptr, size); }
+}
+
+static bool bench(const char* name)
+{
+  FILE* f = fopen(name, "rb");
+  if(!f) return false;
+  std::vector<uint8_t> input(BENCH_MAX_SIZE);
+  input.resize(fread(input.data(), 1, input.size(), f));
+  fclose(f);
+
+  uint64_t allocs_start = allocs;
+  uint32_t images = 0;
+  auto start = std::chrono::steady_clock::now();
+  for(uint32_t i = 0; i < BENCH_RUNS; i++)
+  {
+    img_parse::gif_parse_context_s ctx;
+    if(img_parse::init(ctx, input.data(), input.size()) != img_parse::error_code_ok || img_parse::parse(ctx) != img_parse::error_code_ok)
+    {
+      img_parse::deinit(ctx);
+      return false;
+    }
+    images = ctx.images_size;
+    img_parse::deinit(ctx);
+  }
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / BENCH_RUNS;
+  double decode_allocs = (double)(allocs - allocs_start) / BENCH_RUNS;
+  const char* base = strrchr(name, '/');
+  printf("%-16s %3u images  %7.1f allocs/decode  %5.1f allocs/image  %7.1f us/decode\n", base ? base + 1 : name, images, decode_allocs, decode_allocs / images, us);
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  for(int i = 1; i < argc; i++)
+  {
+    if(!bench(argv[i]))
+    {
+      fprintf(stderr, "%s: decoding failed\n", argv[i]);
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+//host stand-ins of the Arduino ESP8266 core, only what the firmware sources use for loop_bench
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint8_t uint8;
+typedef uint32_t uint32;
+
+unsigned long millis();
+unsigned long micros();
+void yield();
+void delay(unsigned long ms);
+
+class String : public std::string
+{
+public:
+  String() {}
+  String(const char* s) : std::string(s) {}
+  String(const std::string& s) : std::string(s) {}
+  String(int v) : std::string(std::to_string(v)) {}
+  String(unsigned v) : std::string(std::to_string(v)) {}
+  String(long v) : std::string(std::to_string(v)) {}
+  String(unsigned long v) : std::string(std::to_string(v)) {}
+  bool endsWith(const String& s) const { return size() >= s.size() && compare(size() - s.size(), s.size(), s) == 0; }
+  bool startsWith(const String& s) const { return compare(0, s.size(), s) == 0; }
+  long toInt() const { return atol(c_str()); }
+  unsigned length() const { return size(); }
+  String substring(unsigned from, unsigned to) const { return String(substr(from, to - from)); }
+  String substring(unsigned from) const { return String(substr(from)); }
+  int lastIndexOf(char c) const { size_t p = rfind(c); return p == npos ? -1 : (int)p; }
+  int indexOf(char c) const { size_t p = find(c); return p == npos ? -1 : (int)p; }
+  void toLowerCase() {}
+  String operator+(const String& o) const { return String(std::string(*this) + std::string(o)); }
+  String operator+(const char* o) const { return String(std::string(*this) + o); }
+  friend String operator+(const char* a, const String& b) { return String(std::string(a) + std::string(b)); }
+};
+
+struct EspClass
+{
+  uint32_t getFreeHeap();
+  uint32_t getMaxFreeBlockSize();
+  uint32_t getCycleCount();
+};
+extern EspClass ESP;
+
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
@@ -0,0 +1,41 @@
+#pragma once
+//host stand-in of ESPAsyncWebServer: the routes are not served, loop_bench calls the upload handler itself
+
+#include "Arduino.h"
+#include "LittleFS.h"
+#include <functional>
+
+enum WebRequestMethod { HTTP_GET = 1, HTTP_POST = 2, HTTP_DELETE = 4 };
+
+class AsyncWebServerResponse
+{
+public:
+  void addHeader(const String&, const String&) {}
+};
+
+class AsyncWebServerRequest
+{
+public:
+  File _tempFile;
+  void* _tempObject = nullptr;
+  int status = 0; //last status sent
+  void send(int code, const String& = String(), const String& = String()) { status = code; }
+  void send(AsyncWebServerResponse*) {}
+  void send(fs::FS&, const String&, const String& = String(), bool = false, std::function<String(const String&)> = nullptr) {}
+  AsyncWebServerResponse* beginResponse(fs::FS&, const String&, const String& = String(), bool = false, std::function<String(const String&)> = nullptr) { return nullptr; }
+  String arg(const char*) { return String(); }
+  bool hasArg(const char*) { return false; }
+};
+
+typedef std::function<void(AsyncWebServerRequest*)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest*, const String&, size_t, uint8_t*, size_t, bool)> ArUploadHandlerFunction;
+
+class AsyncWebServer
+{
+public:
+  AsyncWebServer(int) {}
+  void on(const char*, ArRequestHandlerFunction) {}
+  void on(const char*, int, ArRequestHandlerFunction) {}
+  void on(const char*, int, ArRequestHandlerFunction, ArUploadHandlerFunction) {}
+  void begin() {}
+};
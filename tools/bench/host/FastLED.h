@@ -0,0 +1,61 @@
+#pragma once
+//host stand-in of FastLED: show() takes as long as the WS2812B data of WS_LED_NUM LEDs (busy wait, the interrupts are off during it on the device)
+
+#include "Arduino.h"
+
+extern uint32_t show_us; //duration of a show, set by the benchmark
+extern uint32_t shows;   //number of shows
+
+struct CHSV
+{
+  uint8_t h, s, v;
+  CHSV(uint8_t h_, uint8_t s_, uint8_t v_) : h(h_), s(s_), v(v_) {}
+};
+
+struct CRGB
+{
+  union
+  {
+    struct { uint8_t r, g, b; };
+    uint8_t raw[3];
+  };
+  CRGB() {}
+  CRGB(uint8_t r_, uint8_t g_, uint8_t b_) : r(r_), g(g_), b(b_) {}
+  CRGB(uint32_t c) : r(c >> 16), g(c >> 8), b(c) {}
+  CRGB(const CHSV&) : r(0), g(0), b(0) {}
+  uint8_t& operator[](int i) { return raw[i]; }
+  const uint8_t& operator[](int i) const { return raw[i]; }
+  bool operator==(const CRGB& o) const { return r == o.r && g == o.g && b == o.b; }
+  bool operator!=(const CRGB& o) const { return !(*this == o); }
+  enum { Black = 0, Red = 0xFF0000, White = 0xFFFFFF };
+};
+
+typedef uint8_t fract8;
+inline void fill_solid(CRGB* leds, int n, const CRGB& c) { for(int i = 0; i < n; i++) leds[i] = c; }
+inline CRGB blend(const CRGB& a, const CRGB& b, fract8 f) { return CRGB(a.r + ((b.r - a.r) * f >> 8), a.g + ((b.g - a.g) * f >> 8), a.b + ((b.b - a.b) * f >> 8)); }
+inline uint8_t scale8(uint8_t a, uint8_t b) { return (a * (1 + b)) >> 8; }
+
+enum EOrder { RGB, GRB };
+template<int PIN> struct WS2812B {};
+struct CLEDController { CLEDController& setCorrection(uint32_t) { return *this; } };
+
+struct CFastLED
+{
+  uint8_t brightness = 255;
+  CLEDController controller;
+  template<template<int> class CHIPSET, int PIN, EOrder ORDER> CLEDController& addLeds(CRGB*, int) { return controller; }
+  void show() { shows++; unsigned long t = micros(); while(micros() - t < show_us); }
+  void show(uint8_t) { show(); }
+  void setBrightness(uint8_t b) { brightness = b; }
+  uint8_t getBrightness() { return brightness; }
+  void setMaxPowerInVoltsAndMilliamps(uint8_t, uint32_t) {}
+  void setDither(uint8_t) {}
+  void clear(bool = false) {}
+};
+extern CFastLED FastLED;
+
+#define DISABLE_DITHER 0
+#define BINARY_DITHER 1
+inline uint32_t calculate_unscaled_power_mW(const CRGB*, uint16_t) { return 0; }
+inline uint8_t calculate_max_brightness_for_power_mW(const CRGB*, uint16_t, uint8_t b, uint32_t) { return b; }
+inline uint8_t calculate_max_brightness_for_power_vmA(const CRGB*, uint16_t, uint8_t b, uint32_t, uint32_t) { return b; }
@@ -0,0 +1,2 @@
+#pragma once
+//host stand-in, the firmware sources include it without using it
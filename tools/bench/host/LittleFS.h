@@ -0,0 +1,72 @@
+#pragma once
+//host stand-in of LittleFS: the paths are files under HOST_FS_ROOT, writes take write_us per call (busy wait, flash programming on the device)
+
+#include "Arduino.h"
+#include <cstdio>
+#include <ctime>
+
+#ifndef HOST_FS_ROOT
+#define HOST_FS_ROOT "fs"
+#endif
+
+extern uint32_t write_us; //duration of a file write, set by the benchmark
+
+namespace fs
+{
+  struct FSInfo { size_t totalBytes, usedBytes; };
+  enum SeekMode { SeekSet, SeekCur, SeekEnd };
+
+  class File
+  {
+  public:
+    FILE* f = nullptr;
+    File() {}
+    explicit File(FILE* p) : f(p) {}
+    operator bool() const { return f != nullptr; }
+    size_t read(uint8_t* buf, size_t n) { return fread(buf, 1, n, f); }
+    int read() { return fgetc(f); }
+    size_t write(const uint8_t* buf, size_t n) { unsigned long t = micros(); while(micros() - t < write_us); return fwrite(buf, 1, n, f); }
+    size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t write(uint8_t c) { return write(&c, 1); }
+    bool seek(uint32_t pos, SeekMode mode = SeekSet) { return fseek(f, pos, mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR : SEEK_END) == 0; }
+    size_t position() const { return ftell(f); }
+    size_t size() const { long p = ftell(f); fseek(f, 0, SEEK_END); long s = ftell(f); fseek(f, p, SEEK_SET); return s; }
+    int available() { return (int)(size() - position()); }
+    void close() { if(f) fclose(f); f = nullptr; }
+    String readString() { String s; int c; while((c = fgetc(f)) != EOF) s.push_back((char)c); return s; }
+    const char* name() const { return ""; }
+    void flush() {}
+    bool truncate(uint32_t) { return true; }
+  };
+
+  class Dir
+  {
+  public:
+    bool next() { return false; }
+    String fileName() { return ""; }
+    size_t fileSize() { return 0; }
+    void rewind() {}
+    bool isFile() const { return true; }
+    time_t fileTime() { return 0; }
+  };
+
+  class FS
+  {
+  public:
+    bool begin() { return true; }
+    File open(const String& path, const char* mode) { return File(fopen((HOST_FS_ROOT + path).c_str(), mode)); }
+    Dir openDir(const String&) { return Dir(); }
+    bool remove(const String& path) { return ::remove((HOST_FS_ROOT + path).c_str()) == 0; }
+    bool rename(const String& from, const String& to) { return ::rename((HOST_FS_ROOT + from).c_str(), (HOST_FS_ROOT + to).c_str()) == 0; }
+    bool exists(const String& path) { FILE* f = fopen((HOST_FS_ROOT + path).c_str(), "r"); if(f) fclose(f); return f != nullptr; }
+    bool info(FSInfo& info) { info = FSInfo{0, 0}; return true; }
+    bool mkdir(const String&) { return true; }
+  };
+}
+
+using fs::File;
+using fs::Dir;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+extern fs::FS LittleFS;
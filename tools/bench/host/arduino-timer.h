@@ -0,0 +1,55 @@
+#pragma once
+//host model of arduino-timer: repeating and one shot tasks run by tick(), a handler returning false removes its task
+
+#include "Arduino.h"
+
+template <size_t max_tasks = 16, unsigned long (*time_func)() = millis, typename T = void*>
+class Timer
+{
+public:
+  typedef bool (*handler_t)(T);
+  typedef void* Task;
+
+  struct task_s
+  {
+    handler_t handler;
+    T opaque;
+    unsigned long start;
+    unsigned long expires;
+    bool repeat;
+    bool used;
+  } tasks[max_tasks] = {};
+
+  Task add(unsigned long interval, handler_t handler, T opaque, bool repeat)
+  {
+    for(size_t i = 0; i < max_tasks; i++)
+    {
+      if(tasks[i].used) continue;
+      tasks[i] = {handler, opaque, time_func(), interval, repeat, true};
+      return (Task)&tasks[i];
+    }
+    return nullptr;
+  }
+  Task every(unsigned long interval, handler_t handler, T opaque = T()) { return add(interval, handler, opaque, true); }
+  Task in(unsigned long delay, handler_t handler, T opaque = T()) { return add(delay, handler, opaque, false); }
+  Task at(unsigned long time, handler_t handler, T opaque = T()) { return add(time - time_func(), handler, opaque, false); }
+  void cancel() { for(task_s& t : tasks) t.used = false; }
+  void cancel(Task& task) { if(task) ((task_s*)task)->used = false; task = nullptr; }
+
+  unsigned long tick()
+  {
+    unsigned long now = time_func();
+    for(task_s& t : tasks)
+    {
+      if(!t.used || now - t.start < t.expires) continue;
+      task_s run = t;
+      bool keep = run.handler(run.opaque);
+      //the handler may have cancelled or replaced the task
+      if(!keep || !run.repeat) { if(t.used && t.handler == run.handler && t.start == run.start) t.used = false; }
+      else if(t.used && t.start == run.start) t.start = now;
+    }
+    return 0;
+  }
+  size_t size() const { size_t n = 0; for(const task_s& t : tasks) n += t.used; return n; }
+  bool empty() const { return size() == 0; }
+};
@@ -0,0 +1,24 @@
+//definitions of the host stand-ins
+#include "FastLED.h"
+#include "LittleFS.h"
+
+#include <chrono>
+
+CFastLED FastLED;
+EspClass ESP;
+fs::FS LittleFS;
+
+uint32_t show_us = 0;
+uint32_t shows = 0;
+uint32_t write_us = 0;
+
+static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+unsigned long millis() { return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(); }
+unsigned long micros() { return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(); }
+void yield() {}
+void delay(unsigned long ms) { unsigned long t = millis(); while(millis() - t < ms); }
+
+uint32_t EspClass::getFreeHeap() { return 40000; }
+uint32_t EspClass::getMaxFreeBlockSize() { return 30000; }
+uint32_t EspClass::getCycleCount() { return (uint32_t)micros() * 80; }
@@ -0,0 +1,113 @@
+/* host benchmark of tinf: MB/s of inflated output on the zlib streams given as arguments (make_idat_corpus.py), best of the runs
+ * every stream's output is checked against its .out file, built against the original tinf (without workspace) it measures the bit by bit tree walk
+ */
+
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+
+#include "tinf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_RUNS 15
+#define BENCH_MAX_SIZE (1 << 22)
+
+static unsigned char compressed[BENCH_MAX_SIZE], expected[BENCH_MAX_SIZE], out[BENCH_MAX_SIZE];
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static unsigned int read_file(const char *name, unsigned char *buf)
+{
+	FILE *f = fopen(name, "rb");
+	unsigned int len;
+	if (!f) {
+		return 0;
+	}
+	len = (unsigned int) fread(buf, 1, BENCH_MAX_SIZE, f);
+	fclose(f);
+	return len;
+}
+
+/* raw deflate data of the zlib stream, without the 2 byte header and the adler32 */
+static int inflate_once(unsigned char *dest, unsigned int *destLen, const unsigned char *source, unsigned int sourceLen, int fast, void *workspace)
+{
+#ifdef TINF_WORKSPACE_SIZE
+	if (fast) {
+		return tinf_uncompress_ws(dest, destLen, source + 2, sourceLen - 6, workspace);
+	}
+#endif
+	(void) fast;
+	(void) workspace;
+	return tinf_uncompress(dest, destLen, source + 2, sourceLen - 6);
+}
+
+int main(int argc, char *argv[])
+{
+	double total_bytes = 0, total_time[2] = {0, 0};
+	int variants = 1, bad = 0;
+	void *workspace = NULL;
+
+	tinf_init();
+#ifdef TINF_WORKSPACE_SIZE
+	variants = 2;
+	workspace = malloc(TINF_WORKSPACE_SIZE);
+	printf("%-30s %8s %8s  %14s %14s\n", "stream", "in", "out", "tinf_uncompress", "with workspace");
+#else
+	printf("%-30s %8s %8s  %14s\n", "stream", "in", "out", "tinf_uncompress");
+#endif
+
+	for (int i = 1; i < argc; i++) {
+		char out_name[512];
+		unsigned int len = read_file(argv[i], compressed);
+		unsigned int expected_len;
+		const char *name = strrchr(argv[i], '/');
+
+		snprintf(out_name, sizeof(out_name), "%s.out", argv[i]);
+		expected_len = read_file(out_name, expected);
+		if (len < 6) {
+			printf("%s: can't read\n", argv[i]);
+			bad++;
+			continue;
+		}
+		printf("%-30s %8u %8u ", name ? name + 1 : argv[i], len, expected_len);
+
+		for (int fast = 0; fast < variants; fast++) {
+			double best = 1e9;
+			unsigned int out_len = 0;
+			int res = TINF_OK;
+			for (int run = 0; run < BENCH_RUNS && res == TINF_OK; run++) {
+				double t = now();
+				out_len = sizeof(out);
+				res = inflate_once(out, &out_len, compressed, len, fast, workspace);
+				t = now() - t;
+				if (t < best) {
+					best = t;
+				}
+			}
+			if (res != TINF_OK || out_len != expected_len || memcmp(out, expected, out_len) != 0) {
+				printf(" %14s", "MISMATCH");
+				bad++;
+				continue;
+			}
+			printf(" %9.1f MB/s", out_len / best / 1e6);
+			total_time[fast] += best;
+		}
+		total_bytes += expected_len;
+		printf("\n");
+	}
+
+	printf("%-30s %17s ", "total", "");
+	for (int fast = 0; fast < variants; fast++) {
+		printf(" %9.1f MB/s", total_bytes / total_time[fast] / 1e6);
+	}
+	printf("\n");
+	free(workspace);
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+//host model of the firmware's main loop: loop latency with a still image displayed and upload throughput through web::image_upload
+//built with the stand-ins in host/, FastLED.show() takes as long as the WS2812B data (the interrupts are off during it on the device)
+//the upload arrives as TCP segments at the link rate, the web server's callback gets one segment between two loop iterations (the SDK runs loop() and the network tasks in turns on the device)
+//and the sender waits for the acknowledgement of the segment BENCH_WINDOW places before, so a loop held up by a show delays the following segments
+//usage: loop_bench [write_us [file]], write_us: time a LittleFS write of a segment takes, file: upload this instead of random bytes
+
+#include "ws2812b_8x8.hpp"
+#include "state_machine.hpp"
+#include "web.hpp"
+
+#include <cstdio>
+#include <algorithm>
+#include <vector>
+
+#define BENCH_SHOW_US (WS_LED_NUM * 24 * 5 / 4 + 50) //64 LEDs * 24 bits * 1.25 us plus the reset
+#define BENCH_WARMUP_MS 1000 //the transition to the first uploaded image is not measured
+#define BENCH_IDLE_MS 5000   //still image measured this long (the 10 s refresh of unchanged content is not in it)
+#define BENCH_SEGMENT 1460   //TCP MSS
+#define BENCH_WINDOW 2       //unacknowledged segments in flight, TCP_WND of the lwIP build
+#define BENCH_LINK_US 2000   //arrival interval of the segments, about 730 KB/s WiFi
+#define BENCH_UPLOAD_SIZE (64 * 1024)
+#define BENCH_UPLOADS 8      //the file is uploaded this many times one after another
+#define BENCH_MAX_US 100000  //range of the loop latency histogram
+
+namespace pixelbox
+{
+  namespace web { void image_upload(AsyncWebServerRequest* request, String filename, size_t index, uint8_t* data, size_t len, bool final); } //not in the header, the server calls it
+}
+
+typedef struct latency_s   //loop iteration durations
+{
+  uint64_t count[BENCH_MAX_US + 1];  //histogram in us, longer iterations are counted in the last one
+  uint32_t max_us;
+  uint64_t stalled_us;  //time in iterations longer than 1 ms
+}latency_s;
+
+static void loop_once(latency_s* latency, bool firmware = true) //without the firmware it measures the host's own scheduling stalls
+{
+  uint32_t t = micros();
+  if(firmware)
+  {
+    pixelbox::ws2812b_8x8::loop();
+    pixelbox::state_machine::loop();
+  }
+  t = micros() - t;
+  latency->count[std::min(t, (uint32_t)BENCH_MAX_US)]++;
+  latency->max_us = std::max(latency->max_us, t);
+  if(t > 1000) latency->stalled_us += t;
+}
+
+static void print_latency(const char* name, latency_s* latency, uint32_t elapsed_us) //shows counted since the measurement started
+{
+  uint64_t total = 0, over = 0, below = 0;
+  for(uint32_t i = 0; i <= BENCH_MAX_US; i++)
+  {
+    total += latency->count[i];
+    if(i > 1000) over += latency->count[i];
+  }
+  uint32_t p999 = 0;
+  while(below + latency->count[p999] < total - total / 1000) below += latency->count[p999++];
+  printf("%-7s %5.1f shows/s  loop p99.9 %5u us  max %5u us  %6.2f stalls/s over 1 ms  %5.1f ms/s stalled\n", name,
+         shows * 1e6 / elapsed_us, p999, latency->max_us, over * 1e6 / elapsed_us, latency->stalled_us * 1e3 / elapsed_us);
+}
+
+typedef struct upload_stats_s   //timing of the segments
+{
+  uint32_t elapsed_us;  //first segment's arrival to the last one handled
+  uint64_t wait_us;     //segments' arrival to their callback
+  uint32_t max_wait_us;
+  uint32_t segments;
+}upload_stats_s;
+
+static void upload(const std::vector<uint8_t>& data, const String& name, uint32_t uploads, latency_s* latency, upload_stats_s* stats)
+{
+  //segment i arrives BENCH_LINK_US after segment i - 1 and not before segment i - BENCH_WINDOW was handled
+  uint32_t file_segments = (data.size() + BENCH_SEGMENT - 1) / BENCH_SEGMENT;
+  uint32_t segments = file_segments * uploads;
+  std::vector<uint32_t> handled(segments);
+  AsyncWebServerRequest request;
+  uint32_t next = 0;
+  uint32_t start = micros();
+  uint32_t arrival = start;
+  while(next < segments)
+  {
+    loop_once(latency);
+    uint32_t now = micros();
+    if((int32_t)(now - arrival) < 0) continue;
+    stats->wait_us += now - arrival;
+    stats->max_wait_us = std::max(stats->max_wait_us, now - arrival);
+    size_t index = (size_t)(next % file_segments) * BENCH_SEGMENT;
+    size_t len = std::min((size_t)BENCH_SEGMENT, data.size() - index);
+    bool final = next % file_segments == file_segments - 1;
+    pixelbox::web::image_upload(&request, name, index, (uint8_t*)data.data() + index, len, final);
+    if(final && request._tempObject)
+    {
+      free(request._tempObject); //the request is deleted after the upload on the device
+      request._tempObject = NULL;
+    }
+    handled[next++] = micros();
+    if(next < segments)
+    {
+      arrival += BENCH_LINK_US;
+      if(next >= BENCH_WINDOW && (int32_t)(handled[next - BENCH_WINDOW] - arrival) > 0) arrival = handled[next - BENCH_WINDOW];
+    }
+  }
+  stats->elapsed_us = handled[segments - 1] - start;
+  stats->segments += segments;
+}
+
+int main(int argc, char* argv[])
+{
+  write_us = argc > 1 ? atoi(argv[1]) : 0;
+
+  //the upload: a file or random bytes of an unknown format (displayed as the red error color afterwards, a still too)
+  std::vector<uint8_t> data;
+  String name = "loop_bench.bin";
+  if(argc > 2)
+  {
+    FILE* f = fopen(argv[2], "rb");
+    if(!f) return 1;
+    uint8_t buffer[4096];
+    size_t n;
+    while((n = fread(buffer, 1, sizeof(buffer), f)) > 0) data.insert(data.end(), buffer, buffer + n);
+    fclose(f);
+    const char* base = strrchr(argv[2], '/');
+    name = base ? base + 1 : argv[2];
+  }
+  else for(size_t i = 0; i < BENCH_UPLOAD_SIZE; i++) data.push_back(rand());
+
+  //noise floor of the host
+  static latency_s host, idle, uploading;
+  uint32_t start = micros();
+  while(micros() - start < BENCH_IDLE_MS * 1000) loop_once(&host, false);
+  print_latency("host", &host, micros() - start);
+
+  //startup like main.cpp, the connecting image is a still
+  LittleFS.remove("/displayed_image");
+  show_us = BENCH_SHOW_US;
+  pixelbox::ws2812b_8x8::setup();
+  pixelbox::state_machine::setup();
+  pixelbox::web::add_updated_cb(pixelbox::state_machine::image_updated);
+
+  //the first upload switches the display to its image, the measured uploads don't change it any more
+  upload_stats_s stats = {};
+  upload(data, name, 1, &idle, &stats);
+  start = micros();
+  while(micros() - start < BENCH_WARMUP_MS * 1000) loop_once(&idle);
+
+  //still image
+  memset(&idle, 0, sizeof(idle));
+  shows = 0;
+  start = micros();
+  while(micros() - start < BENCH_IDLE_MS * 1000) loop_once(&idle);
+  print_latency("idle", &idle, micros() - start);
+
+  //uploads of the displayed image
+  stats = {};
+  shows = 0;
+  upload(data, name, BENCH_UPLOADS, &uploading, &stats);
+  print_latency("upload", &uploading, stats.elapsed_us);
+  printf("upload  %u x %zu B, %u us per write: %6.1f KB/s, segment wait mean %5.0f us  max %5u us\n", BENCH_UPLOADS, data.size(), write_us,
+         (double)data.size() * BENCH_UPLOADS * 1e3 / stats.elapsed_us, (double)stats.wait_us / stats.segments, stats.max_wait_us);
+
+  LittleFS.remove("/images/" + name);
+  LittleFS.remove("/native/" + name);
+  LittleFS.remove("/meta/" + name);
+  LittleFS.remove("/displayed_image");
+  return 0;
+}
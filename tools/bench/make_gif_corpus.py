@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+# writes the GIF files used by gif_bench into corpus/
+# a minimal GIF89a encoder: global palette, one graphic control extension per frame, LZW with a clear code when the table is full
+import os
+import random
+import struct
+import sys
+
+random.seed(1)
+out_dir = sys.argv[1] if len(sys.argv) > 1 else 'corpus'
+os.makedirs(out_dir, exist_ok=True)
+
+def lzw(indices, min_code_size):
+    clear = 1 << min_code_size
+    out = bytearray()
+    bits = 0
+    bit_count = 0
+    def emit(code, size):
+        nonlocal bits, bit_count
+        bits |= code << bit_count
+        bit_count += size
+        while bit_count >= 8:
+            out.append(bits & 0xFF)
+            bits >>= 8
+            bit_count -= 8
+    def reset():
+        return min_code_size + 1, {(i,): i for i in range(clear)}, clear + 2
+    size, table, next_code = reset()
+    emit(clear, size)
+    string = ()
+    for index in indices:
+        if string + (index,) in table:
+            string += (index,)
+            continue
+        emit(table[string], size)
+        if next_code < 4096:
+            table[string + (index,)] = next_code
+            next_code += 1
+            if next_code > (1 << size) and size < 12:
+                size += 1
+        else:
+            emit(clear, size)
+            size, table, next_code = reset()
+        string = (index,)
+    if string:
+        emit(table[string], size)
+    emit(clear + 1, size)
+    if bit_count:
+        out.append(bits & 0xFF)
+    return bytes(out)
+
+def gif(width, height, palette, frames):
+    depth = 1
+    while (1 << depth) < len(palette):
+        depth += 1
+    palette = palette + [(0, 0, 0)] * ((1 << depth) - len(palette))
+    data = b'GIF89a' + struct.pack('<HHBBB', width, height, 0x80 | (depth - 1), 0, 0) + b''.join(bytes(color) for color in palette)
+    data += b'\x21\xff\x0bNETSCAPE2.0\x03\x01\x00\x00\x00'
+    for indices, delay in frames:
+        data += b'\x21\xf9\x04\x00' + struct.pack('<H', delay) + b'\x00\x00'
+        data += b'\x2c' + struct.pack('<HHHHB', 0, 0, width, height, 0)
+        min_code_size = max(2, depth)
+        lzw_data = lzw(indices, min_code_size)
+        data += bytes([min_code_size])
+        for i in range(0, len(lzw_data), 255):
+            data += bytes([len(lzw_data[i:i + 255])]) + lzw_data[i:i + 255]
+        data += b'\x00'
+    return data + b'\x3b'
+
+def save(name, data):
+    with open(os.path.join(out_dir, name), 'wb') as f:
+        f.write(data)
+
+palette = [(random.randrange(256), random.randrange(256), random.randrange(256)) for _ in range(16)]
+
+# busy 8x8 animation: 60 frames of noise, short LZW strings
+save('noise_8x8x60.gif', gif(8, 8, palette, [([random.randrange(16) for _ in range(64)], 5) for _ in range(60)]))
+# calm 8x8 animation: a dot moving over a solid background, long LZW strings
+save('dot_8x8x64.gif', gif(8, 8, palette, [([5 if j == i else 0 for j in range(64)], 3) for i in range(64)]))
+# 64x64 still of noise, fills the 4096 code table and clears it
+save('still_64x64.gif', gif(64, 64, palette, [([random.randrange(16) for _ in range(4096)], 0)]))
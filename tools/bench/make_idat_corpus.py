@@ -0,0 +1,34 @@
+#!/usr/bin/env python3
+# writes the zlib streams of PNG IDAT data used by inflate_bench into corpus/
+# every stream is a set of filtered scanlines (random filter byte per row) like an encoder's IDAT, with its raw bytes next to it (.z.out) for checking
+import os
+import random
+import sys
+import zlib
+
+random.seed(5)
+out_dir = sys.argv[1] if len(sys.argv) > 1 else 'corpus'
+os.makedirs(out_dir, exist_ok=True)
+
+def save(name, raw, level=9):
+    with open(os.path.join(out_dir, name + '.z'), 'wb') as f:
+        f.write(zlib.compress(raw, level))
+    with open(os.path.join(out_dir, name + '.z.out'), 'wb') as f:
+        f.write(raw)
+
+def rows(width, height, pixel):
+    return b''.join(bytes([random.choice([0, 1, 2, 4])]) + b''.join(pixel(x, y) for x in range(width)) for y in range(height))
+
+palette = [bytes(random.randrange(256) for _ in range(3)) for _ in range(16)]
+
+# pixel art: flat areas, long matches
+save('pixelart_rgb_64x64x16frames', rows(64, 64 * 16, lambda x, y: palette[((x // 4) ^ (y // 4) + (y // 64)) % 16]))
+save('pixelart_idx4_256x256', rows(128, 256, lambda x, y: bytes([(((2 * x) // 8 ^ y // 8) % 16) << 4 | (((2 * x + 1) // 8 ^ y // 8) % 16)])))
+save('pixelart_rgba_128x128', rows(128, 128, lambda x, y: palette[(x // 8 + y // 8) % 16] + bytes([0 if (x // 8 + y // 8) % 5 == 0 else 255])))
+save('sheet_rgb_8x8x256frames', rows(8, 8 * 256, lambda x, y: palette[(x * 3 + y + y // 8) % 16]))
+
+# gradients and noise: short matches, many literals
+save('gradient_rgb_300x300', rows(300, 300, lambda x, y: bytes([(x + y) & 255, (x * 2) & 255, (y * 3 + random.randrange(4)) & 255])))
+save('gradient_gray_256x256', rows(256, 256, lambda x, y: bytes([(x + (y >> 1)) & 255])))
+save('noisy_rgba_200x200', rows(200, 200, lambda x, y: bytes([(x + random.randrange(16)) & 255, y & 255, random.randrange(256), 255])))
+save('photo_like_rgb_320x240', rows(320, 240, lambda x, y: bytes([int(128 + 100 * ((x * y) % 97) / 97) & 255, (x ^ y) & 255, random.randrange(40)])), 6)
@@ -0,0 +1,74 @@
+//host test of the renderer's frame deadlines: long frame delays stay on the LEDs instead of wrapping the micros() timeline
+//built with the stand-ins in host/, the renderer runs on the host's clock
+//usage: schedule_test, exits with 1 if a case fails
+
+#include "ws2812b_8x8.hpp"
+
+#include <cstdio>
+
+#define TEST_RUN_MS 100  //the renderer's loop runs this long per case
+
+namespace pixelbox
+{
+  namespace ws2812b_8x8 { extern CRGB canvas[]; } //not in the header, the framebuffer is the renderer's
+}
+
+typedef struct schedule_case_s
+{
+  const char* name;
+  uint32_t delay_ms;        //delay of the first frame, the second one is shown 100 ms
+  uint32_t frames;          //frames rendered by the loop in TEST_RUN_MS (the first one is rendered when the animation is set)
+  uint32_t played_ms;       //summed clamped delays of the rendered frames
+}schedule_case_s;
+
+static const schedule_case_s cases[] = {
+  {"20 ms frame advances",     20,         1, 20 + 100},
+  {"longest GIF delay",        655350,     0, 655350},
+  {"over the signed us range", 3000000,    0, WS_MAX_FRAME_DELAY}, //the deadline looked 1.3e9 us late
+  {"over the uint32 us range", 4294968,    0, WS_MAX_FRAME_DELAY}, //the deadline wrapped to 704 us ahead
+  {"largest delay",            0xFFFFFFFF, 0, WS_MAX_FRAME_DELAY},
+};
+
+static void add_color_frame(pixelbox::anim::animation_s* anim, CRGB color, uint32_t delay_ms) //full canvas frame of one color
+{
+  static CRGB pixels[WS_LED_NUM];
+  fill_solid(pixels, WS_LED_NUM, color);
+  pixelbox::anim::frame_s frame = {};
+  frame.delay_ms = delay_ms;
+  frame.width = WS_LED_WIDTH;
+  frame.height = WS_LED_HEIGHT;
+  frame.pixels = pixels;
+  frame.pixels_size = WS_LED_NUM;
+  pixelbox::anim::add_frame(anim, &frame);
+}
+
+static bool run_case(const schedule_case_s& test)
+{
+  //the first frame is red with the tested delay, the second one green
+  pixelbox::anim::animation_s animation = {};
+  add_color_frame(&animation, CRGB(255, 0, 0), test.delay_ms);
+  add_color_frame(&animation, CRGB(0, 255, 0), 100);
+  pixelbox::ws2812b_8x8::set(&animation);
+
+  uint32_t start = millis();
+  while(millis() - start < TEST_RUN_MS) pixelbox::ws2812b_8x8::loop();
+
+  const pixelbox::ws2812b_8x8::render_stats_s* stats = pixelbox::ws2812b_8x8::get_render_stats();
+  //the first frame stays displayed until its deadline
+  CRGB displayed = test.frames ? CRGB(0, 255, 0) : CRGB(255, 0, 0);
+  bool ok = stats->frames == test.frames && stats->played_ms == test.played_ms && stats->coalesced == 0 && stats->resyncs == 0 &&
+            pixelbox::ws2812b_8x8::canvas[0] == displayed;
+  printf("%-4s %-28s frames %3u  coalesced %u  resyncs %u  played %u ms\n", ok ? "ok" : "FAIL", test.name,
+         stats->frames, stats->coalesced, stats->resyncs, stats->played_ms);
+  return ok;
+}
+
+int main()
+{
+  pixelbox::ws2812b_8x8::setup();
+  pixelbox::ws2812b_8x8::set_transition(pixelbox::ws2812b_8x8::transition_cut, 0);
+
+  bool ok = true;
+  for(const schedule_case_s& test : cases) ok = run_case(test) && ok;
+  return ok ? 0 : 1;
+}
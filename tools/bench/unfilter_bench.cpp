@@ -0,0 +1,122 @@
+//host benchmark of the PNG unfilter kernels: bytes per cycle of img_parse::unfilter_scanline against the generic per byte loop it replaced
+//every filter and pixel size is timed on one 960 byte scanline (best of the runs) and its output is checked against the generic loop
+
+#include "png_parse.hpp"
+
+#include <cstdio>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64_t ticks() { return __rdtsc(); }
+static const char* tick_unit = "bytes/cycle";
+#else
+#include <chrono>
+static uint64_t ticks() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+static const char* tick_unit = "bytes/ns";
+#endif
+
+namespace img_parse { bool unfilter_scanline(png_parse_context_s& ctx); } //not in the header, the parser calls it per inflated row
+
+#define BENCH_STRIDE 960  //divisible by every pixel size
+#define BENCH_RUNS 2000
+
+//the generic loop of the original parser: offsets recomputed and the first pixel / first row branches taken for every byte
+static uint8_t ref_paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+  int p = a + b - c;
+  int pa = abs(p - a);
+  int pb = abs(p - b);
+  int pc = abs(p - c);
+  if(pa <= pb && pa <= pc) return a;
+  if(pb <= pc) return b;
+  return c;
+}
+
+static void ref_unfilter(uint8_t filter, const uint8_t* inflated, uint8_t* unfiltered, uint32_t stride, uint32_t scanline_index, uint32_t pixel_size)
+{
+  //inflated holds the scanlines with their filter bytes, unfiltered the scanlines without them
+  for(uint32_t i = 0; i < stride; i++)
+  {
+    uint8_t* out = &unfiltered[stride * scanline_index + i];
+    *out = inflated[(stride + 1) * scanline_index + 1 + i];
+    uint8_t a = i >= pixel_size ? unfiltered[stride * scanline_index + i - pixel_size] : 0;
+    uint8_t b = scanline_index > 0 ? unfiltered[stride * (scanline_index - 1) + i] : 0;
+    uint8_t c = i >= pixel_size && scanline_index > 0 ? unfiltered[stride * (scanline_index - 1) + i - pixel_size] : 0;
+    switch (filter)
+    {
+    case img_parse::filter_method_sub: *out += a; break;
+    case img_parse::filter_method_up: *out += b; break;
+    case img_parse::filter_method_avg: *out += (a + b) / 2; break;
+    case img_parse::filter_method_paeth: *out += ref_paeth(a, b, c); break;
+    default: break;
+    }
+  }
+}
+
+int main()
+{
+  const uint32_t pixel_sizes[] = {1, 2, 3, 4, 6, 8};
+  const char* names[] = {"none", "sub", "up", "avg", "paeth"};
+  uint32_t stride = BENCH_STRIDE;
+  bool ok = true;
+
+  //the rows are laid out like in the parser: filter byte first, the scanline data 4 byte aligned
+  std::vector<uint8_t> buffer(2 * (stride + 8) + 64);
+  uint8_t* base = (uint8_t*)(((uintptr_t)buffer.data() + 15) & ~(uintptr_t)15);
+  std::vector<uint8_t> inflated(2 * (stride + 1)), unfiltered(2 * stride), input(stride + 1), prior(stride + 1);
+  for(uint32_t i = 0; i <= stride; i++)
+  {
+    input[i] = rand();
+    prior[i] = rand();
+  }
+
+  printf("%s, new / old\nbpp", tick_unit);
+  for(int f = 0; f < 5; f++) printf("\t%s", names[f]);
+  printf("\n");
+  for(uint32_t pixel_size : pixel_sizes)
+  {
+    printf("%u", pixel_size);
+    for(uint8_t filter = 0; filter < 5; filter++)
+    {
+      img_parse::png_parse_context_s ctx;
+      memset(&ctx, 0, sizeof(ctx));
+      ctx.row = base + 3;
+      ctx.prev_row = base + 3 + stride + 8;
+      ctx.stride = stride;
+      ctx.pixel_size = pixel_size;
+      ctx.channels = 1;
+      memcpy(ctx.prev_row + 1, prior.data() + 1, stride);
+
+      //the previous unfiltered scanline of the generic loop is the same prior
+      memcpy(unfiltered.data(), prior.data() + 1, stride);
+      memcpy(inflated.data() + stride + 1, input.data(), stride + 1);
+
+      //both versions on the second scanline, so every filter uses its prior
+      uint64_t best = ~0ull, ref_best = ~0ull;
+      for(int run = 0; run < BENCH_RUNS; run++)
+      {
+        memcpy(ctx.row + 1, input.data() + 1, stride);
+        ctx.row[0] = filter;
+        ctx.scanline_index = 1;
+        uint64_t t = ticks();
+        img_parse::unfilter_scanline(ctx);
+        t = ticks() - t;
+        if(t < best) best = t;
+
+        t = ticks();
+        ref_unfilter(filter, inflated.data(), unfiltered.data(), stride, 1, pixel_size);
+        t = ticks() - t;
+        if(t < ref_best) ref_best = t;
+      }
+      if(memcmp(ctx.row + 1, unfiltered.data() + stride, stride) != 0)
+      {
+        printf("\tMISMATCH");
+        ok = false;
+        continue;
+      }
+      printf("\t%.2f/%.2f", (double)stride / best, (double)stride / ref_best);
+    }
+    printf("\n");
+  }
+  return ok ? 0 : 1;
+}